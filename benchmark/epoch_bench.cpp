@@ -0,0 +1,118 @@
+#include <glog/logging.h>
+#include <memory>
+#include "../epoch_manager.h"
+#include "bench_common.h"
+
+static const constexpr uint32_t kSlotCnt = 4096;
+static const constexpr uint32_t kBumpCnt = 20000;
+static const constexpr uint32_t kProtectCnt = 10000000;
+static const constexpr uint32_t kBumpInterval = 4096;
+
+/// Measures BumpCurrentEpoch(), i.e., the ComputeNewSafeToReclaimEpoch() scan,
+/// over a table with kSlotCnt reserved entries, one in sixteen protected.
+struct ScanBench : public PerformanceTest {
+  explicit ScanBench(uint32_t options) : options_{options} {}
+
+  const char* GetBenchName() override {
+    return (options_ & EpochManager::kPackedScan) ? "PackedScanBench"
+                                                  : "ScanBench";
+  }
+
+  void Setup() override {
+    epoch_manager_.Initialize(options_);
+    auto* table = epoch_manager_.epoch_table_;
+    for (uint32_t i = 0; i < kSlotCnt; i += 1) {
+      auto* entry = table->ReserveEntry(i, i + 1);
+      if (i % 16 == 0) {
+        entry->protected_epoch = 1;
+        if (entry->packed_epoch) *entry->packed_epoch = 1;
+      }
+    }
+  }
+
+  void Entry(size_t, size_t) override {
+    WaitForStart();
+    for (uint32_t i = 0; i < kBumpCnt; i += 1) {
+      epoch_manager_.BumpCurrentEpoch();
+    }
+  }
+
+  void Teardown() override { epoch_manager_.Uninitialize(); }
+
+  uint32_t options_;
+  EpochManager epoch_manager_;
+};
+
+/// Measures the read side: every thread enters and leaves the protected region
+/// through EpochGuard kProtectCnt times, thread 0 also bumps the epoch every
+/// kBumpInterval iterations.
+struct ProtectBench : public PerformanceTest {
+  explicit ProtectBench(uint32_t options) : options_{options} {}
+
+  const char* GetBenchName() override {
+    if (options_ & EpochManager::kPerCpu) return "PerCpuProtectBench";
+    return (options_ & EpochManager::kAsymmetricFence) ? "MembarrierProtectBench"
+                                                       : "ProtectBench";
+  }
+
+  void Setup() override { epoch_manager_.Initialize(options_); }
+
+  void Entry(size_t thread_idx, size_t) override {
+    WaitForStart();
+    for (uint32_t i = 0; i < kProtectCnt; i += 1) {
+      EpochGuard guard(&epoch_manager_);
+      if (thread_idx == 0 && i % kBumpInterval == 0) {
+        epoch_manager_.BumpCurrentEpoch();
+      }
+    }
+  }
+
+  void Teardown() override { epoch_manager_.Uninitialize(); }
+
+  uint32_t options_;
+  EpochManager epoch_manager_;
+};
+
+int main(int argc, char** argv) {
+  if (argc == 2) {
+    int32_t bench_to_run = atoi(argv[1]);
+    switch (bench_to_run) {
+      case 1: {
+        std::make_unique<ScanBench>(EpochManager::kDefault)->Run(1);
+        std::make_unique<ScanBench>(EpochManager::kPackedScan)->Run(1);
+        break;
+      }
+      case 2: {
+        std::make_unique<ProtectBench>(EpochManager::kDefault)->Run(4);
+        std::make_unique<ProtectBench>(EpochManager::kAsymmetricFence)->Run(4);
+        std::make_unique<ProtectBench>(EpochManager::kPerCpu)->Run(4);
+        break;
+      }
+      default:
+        break;
+    }
+    return 0;
+  }
+
+  {
+    auto scan_bench = std::make_unique<ScanBench>(EpochManager::kDefault);
+    scan_bench->Run(1);
+  }
+  {
+    auto packed_bench = std::make_unique<ScanBench>(EpochManager::kPackedScan);
+    packed_bench->Run(1);
+  }
+  {
+    auto protect_bench = std::make_unique<ProtectBench>(EpochManager::kDefault);
+    protect_bench->Run(1)->Run(2)->Run(4)->Run(8);
+  }
+  {
+    auto membarrier_bench =
+        std::make_unique<ProtectBench>(EpochManager::kAsymmetricFence);
+    membarrier_bench->Run(1)->Run(2)->Run(4)->Run(8);
+  }
+  {
+    auto per_cpu_bench = std::make_unique<ProtectBench>(EpochManager::kPerCpu);
+    per_cpu_bench->Run(1)->Run(2)->Run(4)->Run(8);
+  }
+}
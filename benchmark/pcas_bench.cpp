@@ -3,7 +3,9 @@
 #include <libpmemobj.h>
 #include <memory>
 #include <random>
+#include <string>
 #include "../pcas.h"
+#include "../pmwcas.h"
 #include "bench_common.h"
 
 POBJ_LAYOUT_BEGIN(benchmark);
@@ -149,8 +151,6 @@ struct DirtyCASBench : public BaseBench {
   const char* GetBenchName() override { return "DirtyCASBench"; }
   DirtyCASBench() : BaseBench() {}
 
-  static const uint64_t kDirtyBitMask = 0x8000000000000000ull;
-
   void Entry(size_t thread_idx, size_t thread_count) override {
     if (thread_idx == 0) {
       WorkLoadInit();
@@ -165,23 +165,80 @@ struct DirtyCASBench : public BaseBench {
       uint32_t pos = dist(rng);
       uint64_t* target =
           array + pos * very_pm::kCacheLineSize / sizeof(uint64_t);
+      uint64_t value =
+          very_pm::PersistentRead<very_pm::DirtyBitPolicy>(target);
+      very_pm::PersistentCAS<very_pm::DirtyBitPolicy>(target, value,
+                                                      value + 1);
+    }
+  }
+};
 
-      uint64_t old_v = *target;
-      while ((old_v & kDirtyBitMask) != 0) {
-        uint64_t cleared = old_v & (~kDirtyBitMask);
-        very_pm::CompareExchange64(target, cleared, old_v);
-        old_v = *target;
-      }
+struct PMwCASBench : public BaseBench {
+  static const constexpr uint32_t kDescriptorCnt = 64 * 16;
 
-      uint64_t new_v = old_v + 1;
-      uint64_t dirty_value = new_v | kDirtyBitMask;
+  const char* GetBenchName() override { return name_.c_str(); }
 
-      very_pm::CompareExchange64(target, dirty_value, old_v);
-      very_pm::flush(target);
-      very_pm::fence();
-      very_pm::CompareExchange64(target, new_v, dirty_value);
+  explicit PMwCASBench(uint32_t word_cnt)
+      : BaseBench(),
+        word_cnt_(word_cnt),
+        name_("PMwCASBench-" + std::to_string(word_cnt)) {}
+
+  uint32_t word_cnt_;
+  std::string name_;
+  EpochManager epoch_manager_;
+  very_pm::DescriptorPool descriptor_pool_;
+  very_pm::Descriptor* descriptors_{nullptr};
+
+  void Entry(size_t thread_idx, size_t thread_count) override {
+    if (thread_idx == 0) {
+      WorkLoadInit();
+      descriptors_ = (very_pm::Descriptor*)ZAlloc(
+          sizeof(very_pm::Descriptor) * kDescriptorCnt);
+      epoch_manager_.Initialize();
+      descriptor_pool_.Initialize(&epoch_manager_, descriptors_,
+                                  kDescriptorCnt);
+    }
+
+    std::uniform_int_distribution<std::mt19937::result_type> dist(
+        0, kArrayLen - 1);
+
+    WaitForStart();
+
+    // Words of one PMwCAS are spread evenly over the array, so they never
+    // collide with each other.
+    const uint32_t stride = kArrayLen / word_cnt_;
+    for (uint32_t i = 0; i < kOpCnt; i += 1) {
+      uint32_t pos = dist(rng);
+      EpochGuard guard(&epoch_manager_);
+      very_pm::Descriptor* descriptor = descriptor_pool_.AllocateDescriptor();
+      // Every op counts: leave the protected region, move the epoch on so
+      // the descriptors this thread retired can expire, and try again.
+      // Descriptors never leave their partition, and every thread has one
+      // of its own as long as the pool has more partitions than threads.
+      while (descriptor == nullptr) {
+        epoch_manager_.Unprotect();
+        epoch_manager_.RequestEpochAdvance();
+        epoch_manager_.Protect();
+        descriptor = descriptor_pool_.AllocateDescriptor();
+      }
+      for (uint32_t w = 0; w < word_cnt_; w += 1) {
+        uint64_t* target = array + ((pos + w * stride) % kArrayLen) *
+                                       very_pm::kCacheLineSize /
+                                       sizeof(uint64_t);
+        uint64_t value = very_pm::PMwCASRead(target);
+        descriptor->AddWord(target, value, value + 1);
+      }
+      descriptor->MwCAS();
     }
   }
+
+  void Teardown() override {
+    BaseBench::Teardown();
+    descriptor_pool_.Uninitialize();
+    epoch_manager_.Uninitialize();
+    auto oid = pmemobj_oid((char*)descriptors_ - very_pm::kPMDK_PADDING);
+    pmemobj_free(&oid);
+  }
 };
 
 int main(int argc, char** argv) {
@@ -204,6 +261,11 @@ int main(int argc, char** argv) {
         dirty_cas_bench->Run(16);
         break;
       }
+      case 4: {
+        auto pmwcas_bench = std::make_unique<PMwCASBench>(2);
+        pmwcas_bench->Run(16);
+        break;
+      }
       default:
         break;
     }
@@ -226,4 +288,8 @@ int main(int argc, char** argv) {
     auto naive_cas_bench = std::make_unique<NaiveCASBench>();
     naive_cas_bench->Run(1)->Run(2)->Run(4)->Run(8)->Run(16)->Run(24);
   }
+  for (uint32_t word_cnt : {1, 2, 4}) {
+    auto pmwcas_bench = std::make_unique<PMwCASBench>(word_cnt);
+    pmwcas_bench->Run(1)->Run(2)->Run(4)->Run(8)->Run(16)->Run(24);
+  }
 }
@@ -0,0 +1,180 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include "garbage_list.h"
+
+/// Bump allocator whose memory is reclaimed a whole generation at a time.
+/// Objects are carved out of blocks owned by the current generation; retiring
+/// an object only decrements the generation's live count, and once the
+/// generation is sealed and its last object retired, all of its blocks go to
+/// the garbage list as a single item. They are freed together when the epoch
+/// of that push is safe to reclaim, i.e. after the last retire.
+///
+/// Retiring costs an atomic decrement and no garbage list slot, and allocating
+/// is a pointer bump, so structures built and torn down in bulk (e.g. batch
+/// built indexes) pay almost nothing per object. Allocate() and Seal() must
+/// be called by one thread at a time; Retire() may be called by any thread.
+/// DRAM only.
+class EpochArena {
+ public:
+  /// Default size of a block; objects never span blocks.
+  static const size_t kDefaultBlockSize = 1024 * 1024;
+
+  EpochArena()
+      : garbage_list_{}, block_size_{}, head_{}, current_{}, offset_{},
+        allocated_{} {}
+
+  /// Seals the current generation, see Seal().
+  ~EpochArena() { Seal(); }
+
+  /// Hand released generations to \a garbage_list, which must not give up
+  /// on a push (e.g. GarbageList::OverflowPolicy::kFail): a generation it
+  /// drops is leaked. \a block_size must be a power of two, blocks are
+  /// aligned to it. Calling this on an initialized arena has no effect.
+  bool Initialize(IGarbageList* garbage_list,
+                  size_t block_size = kDefaultBlockSize) {
+    if (garbage_list_) return true;
+    if (!garbage_list || !IS_POWER_OF_TWO(block_size) ||
+        block_size <= sizeof(Block)) {
+      return false;
+    }
+    garbage_list_ = garbage_list;
+    block_size_ = block_size;
+    return true;
+  }
+
+  /// Allocate \a size bytes aligned to \a alignment (a power of two) from the
+  /// current generation, opening one if needed. Returns nullptr if \a size
+  /// is 0, the object does not fit in a block or the block cannot be
+  /// allocated.
+  void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+    // An empty object could end up at the end of the block, i.e. in the
+    // next one as far as Retire() can tell.
+    if (!size) return nullptr;
+    // Don't open a block, and end the generation's last one early, for an
+    // object that fits in none.
+    size_t first = (sizeof(Block) + alignment - 1) & ~(alignment - 1);
+    if (first >= block_size_ || size > block_size_ - first) return nullptr;
+
+    size_t offset = (offset_ + alignment - 1) & ~(alignment - 1);
+    if (!current_ || offset + size > block_size_) {
+      if (!NewBlock()) return nullptr;
+      offset = first;
+    }
+    offset_ = offset + size;
+    allocated_ += 1;
+    return reinterpret_cast<char*>(current_) + offset;
+  }
+
+  /// Retire \a object, allocated from any EpochArena with blocks of
+  /// \a block_size. Its memory stays valid until its generation is released
+  /// and the epoch has moved on.
+  static void Retire(void* object, size_t block_size) {
+    Block* block = reinterpret_cast<Block*>(
+        reinterpret_cast<uintptr_t>(object) & ~(block_size - 1));
+    Block* head = block->head;
+    // Negative until the generation is sealed, see Seal().
+    if (head->live.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      Release(head);
+    }
+  }
+
+  /// Retire \a object, allocated from this arena.
+  void Retire(void* object) { Retire(object, block_size_); }
+
+  /// Close the current generation: the next Allocate() opens a new one, and
+  /// this one is released once all of its objects are retired (right away if
+  /// they already are).
+  void Seal() {
+    if (!head_) return;
+    Block* head = head_;
+    int64_t allocated = allocated_;
+    head_ = nullptr;
+    current_ = nullptr;
+    allocated_ = 0;
+    if (head->live.fetch_add(allocated, std::memory_order_acq_rel) +
+            allocated ==
+        0) {
+      Release(head);
+    }
+  }
+
+  /// Close the current generation and release it without waiting for its
+  /// objects to be retired one by one: the whole structure built in it is
+  /// dropped at once. None of its objects may be retired individually.
+  void RetireAll() {
+    if (!head_) return;
+    Block* head = head_;
+    head_ = nullptr;
+    current_ = nullptr;
+    allocated_ = 0;
+    Release(head);
+  }
+
+  /// Objects allocated from the current generation.
+  uint64_t GetAllocatedCount() { return allocated_; }
+
+ private:
+  /// Header at the start of every block. The live count and the garbage list
+  /// are only used in the first block of a generation.
+  struct Block {
+    Block* next;
+    Block* head;
+
+    /// Objects allocated minus objects retired, with allocations only added
+    /// in on Seal(): the count can only reach zero once the generation is
+    /// sealed.
+    std::atomic<int64_t> live;
+    IGarbageList* garbage_list;
+  };
+
+  bool NewBlock() {
+    void* mem = nullptr;
+    if (posix_memalign(&mem, block_size_, block_size_)) return false;
+    Block* block = new (mem) Block{nullptr, head_, {0}, garbage_list_};
+    if (!head_) {
+      head_ = block;
+      block->head = block;
+    } else {
+      current_->next = block;
+    }
+    current_ = block;
+    offset_ = sizeof(Block);
+    return true;
+  }
+
+  /// Push the blocks of the generation starting at \a head as one item.
+  static void Release(Block* head) {
+    bool pushed =
+        head->garbage_list->Push(head, &EpochArena::FreeBlocks, nullptr);
+#ifdef TEST_BUILD
+    RAW_CHECK(pushed, "generation dropped by the garbage list");
+#endif
+    (void)pushed;
+  }
+
+  static void FreeBlocks(void*, void* head) {
+    Block* block = reinterpret_cast<Block*>(head);
+    while (block) {
+      Block* next = block->next;
+      free(block);
+      block = next;
+    }
+  }
+
+  IGarbageList* garbage_list_;
+  size_t block_size_;
+
+  /// First and last block of the current generation, nullptr if none is
+  /// open.
+  Block* head_;
+  Block* current_;
+
+  /// Bump pointer into #current_.
+  size_t offset_;
+
+  /// Objects allocated from the current generation, added to its live count
+  /// on Seal().
+  int64_t allocated_;
+};
@@ -10,11 +10,28 @@
 #include <gtest/gtest_prod.h>
 #endif
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <linux/membarrier.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/sysinfo.h>
+#include <unistd.h>
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#endif
+#endif
+
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <list>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 #include "tls_thread.h"
 #include "utils.h"
 
@@ -55,10 +72,61 @@ typedef uint64_t Epoch;
 /// accessing or ever will access the item again).
 class EpochManager {
  public:
+  /// Options picked at Initialize() time, may be or-ed together.
+  enum Options : uint32_t {
+    kDefault = 0,
+
+    /// Mirror the protected epochs into a packed array so that the reclaimer
+    /// computes their minimum with SIMD, loading eight epochs per cache line
+    /// instead of one. Protect()/Unprotect() pay one more store, to a cache
+    /// line shared with seven other threads, so this pays off for tables with
+    /// many entries that are bumped often.
+    kPackedScan = 1 << 0,
+
+    /// Linux only. Protect() publishes its epoch with a plain store and a
+    /// compiler barrier; the reclaimer instead issues
+    /// membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED) before every scan, which
+    /// forces a full barrier on every running thread of the process. Falls
+    /// back to the default protocol if the kernel lacks expedited membarrier.
+    kAsymmetricFence = 1 << 1,
+
+    /// Track protected threads with per-CPU counters instead of per-thread
+    /// entries, see PerCpuTable. The reclamation scan is O(cores) no matter
+    /// how many threads come and go, at the price of an atomic increment on a
+    /// (core-local) cache line per Protect()/Unprotect(). Epochs only advance
+    /// once the readers of the previous epoch have left.
+    kPerCpu = 1 << 2,
+
+    /// Quiescent-state-based reclamation. Protect() only brings the thread
+    /// online (a no-op once it is) and Unprotect() does nothing, so readers
+    /// write no shared memory per operation. Instead every online thread must
+    /// call QuiescentState() periodically, at a point where it holds no
+    /// pointers into protected structures, and ThreadOffline() before it
+    /// blocks or idles; an online thread that does neither holds back
+    /// reclamation indefinitely. Cannot be combined with kPerCpu.
+    kQuiescentState = 1 << 3,
+
+    /// Interval-based reclamation (2GE-IBR). Besides the epoch it entered in,
+    /// every protected thread publishes the latest epoch it has read a
+    /// pointer in, see ProtectPointer(). Together they form the thread's
+    /// reservation interval; IntervalGarbageList only keeps items whose
+    /// [birth, retire] lifetime overlaps a live reservation, so a stalled
+    /// thread pins only the items that were alive while it was reading.
+    /// The epoch-based protocol keeps working for other garbage lists.
+    /// Cannot be combined with kPerCpu or kQuiescentState.
+    kIntervalBased = 1 << 4,
+  };
+
+  /// Reservation interval of a protected thread in kIntervalBased mode.
+  struct Reservation {
+    Epoch lower;
+    Epoch upper;
+  };
+
   EpochManager();
   ~EpochManager();
 
-  bool Initialize();
+  bool Initialize(uint32_t options = kDefault);
   bool Uninitialize();
 
   /// Enter the thread into the protected code region, which guarantees
@@ -73,6 +141,17 @@ class EpochManager {
   ///      storage; the thread may not enter the protected region. Most likely
   ///      the library has entered some non-serviceable state.
   bool Protect() {
+    if (per_cpu_table_) {
+      return per_cpu_table_->Protect(current_epoch_);
+    }
+    if (quiescent_state_) {
+      return epoch_table_->Online(
+          current_epoch_.load(std::memory_order_seq_cst));
+    }
+    if (interval_based_) {
+      return epoch_table_->ProtectInterval(
+          current_epoch_.load(std::memory_order_relaxed));
+    }
     return epoch_table_->Protect(
         current_epoch_.load(std::memory_order_relaxed));
   }
@@ -89,6 +168,10 @@ class EpochManager {
   ///      region. Most likely the library has entered some non-serviceable
   ///      state.
   bool Unprotect() {
+    if (per_cpu_table_) {
+      return per_cpu_table_->Unprotect();
+    }
+    if (quiescent_state_) return true;
     return epoch_table_->Unprotect(
         current_epoch_.load(std::memory_order_relaxed));
   }
@@ -110,13 +193,102 @@ class EpochManager {
 
   /// Returns true if the calling thread is already in the protected code
   /// region (i.e., have already called Protected()).
-  bool IsProtected() { return epoch_table_->IsProtected(); }
+  bool IsProtected() {
+    if (per_cpu_table_) {
+      return per_cpu_table_->IsProtected();
+    }
+    return epoch_table_->IsProtected();
+  }
+
+  /// Whether the manager was initialized with kIntervalBased.
+  bool IsIntervalBased() { return interval_based_; }
+
+  /// kIntervalBased mode only. Read a pointer from \a source inside the
+  /// protected region, first extending the calling thread's reservation to
+  /// the current epoch if the epoch moved since the last read. Every shared
+  /// pointer the thread dereferences must be read through this.
+  template <typename T>
+  T* ProtectPointer(const std::atomic<T*>& source) {
+    MinEpochTable::Entry* entry = nullptr;
+    epoch_table_->GetEntryForThread(&entry);
+    return MinEpochTable::ReadInterval(entry, current_epoch_, source);
+  }
+
+  /// Collect the reservation intervals of all protected threads. Only
+  /// meaningful in kIntervalBased mode.
+  void GetReservations(std::vector<Reservation>* reservations) {
+    reservations->clear();
+    epoch_table_->CollectReservations(reservations);
+  }
+
+  /// kQuiescentState mode only. Announce that the calling thread holds no
+  /// pointers into protected structures, so everything retired before this
+  /// call may be reclaimed as far as this thread is concerned. Brings the
+  /// thread online if it was not.
+  bool QuiescentState() {
+    return epoch_table_->QuiescentState(
+        current_epoch_.load(std::memory_order_seq_cst));
+  }
+
+  /// kQuiescentState mode only. Take the calling thread offline, e.g. before
+  /// it blocks, so it stops holding back reclamation. The next Protect() or
+  /// QuiescentState() brings it back online.
+  bool ThreadOffline() {
+    return epoch_table_->Unprotect(
+        current_epoch_.load(std::memory_order_relaxed));
+  }
 
   void BumpCurrentEpoch();
 
+  /// Ask for the epoch to move forward. With the advancer thread running this
+  /// only wakes it up, so the caller does not pay for the
+  /// ComputeNewSafeToReclaimEpoch() scan; otherwise the epoch is bumped inline.
+  void RequestEpochAdvance() {
+    if (!advancer_running_.load(std::memory_order_relaxed)) {
+      BumpCurrentEpoch();
+      return;
+    }
+    if (advance_requested_.load(std::memory_order_relaxed)) return;
+    {
+      // Under the advancer's mutex, so the request cannot land between its
+      // predicate check and its wait and be slept through.
+      std::lock_guard<std::mutex> lock(advancer_mutex_);
+      advance_requested_.store(true, std::memory_order_relaxed);
+    }
+    advancer_cv_.notify_one();
+  }
+
+  bool StartEpochAdvancer(uint64_t interval_us = 1000);
+  void StopEpochAdvancer();
+
+  /// Invoked with its context once a grace period has elapsed, see
+  /// CallAfterGracePeriod().
+  typedef void (*GracePeriodCallback)(void* context);
+
+  /// Block until every thread that was in the protected region when this was
+  /// called has left it. Sleeps on a futex that is woken whenever the safe
+  /// epoch moves, nudging the epoch forward in between. Must not be called
+  /// from a protected thread (nor an online kQuiescentState thread), which
+  /// would wait for itself; returns false in that case.
+  bool Synchronize();
+
+  /// Run \a callback with \a context once every thread that is in the
+  /// protected region now has left it. The callback runs on whichever thread
+  /// advances the safe epoch far enough, or on Uninitialize(), and must not
+  /// block.
+  bool CallAfterGracePeriod(GracePeriodCallback callback, void* context);
+
+  /// Nudge the epoch forward and sleep until the safe epoch moves or
+  /// \a timeout passes. Returns true if the safe epoch moved. Unlike
+  /// Synchronize() this waits for any progress, so it may be called from a
+  /// protected thread as long as some other thread holds the epoch back.
+  bool WaitForEpochAdvance(std::chrono::microseconds timeout);
+
  public:
   void ComputeNewSafeToReclaimEpoch(Epoch currentEpoch);
 
+  class PerCpuTable;
+
   /// Keeps track of which threads are executing in region protected by
   /// its parent EpochManager. This table does most of the work of the
   /// EpochManager. It allocates a slot in thread local storage. When
@@ -136,10 +308,15 @@ class EpochManager {
     static const uint64_t kDefaultSize = 128;
 
     MinEpochTable();
-    bool Initialize(uint64_t size = MinEpochTable::kDefaultSize);
+    bool Initialize(uint64_t size = MinEpochTable::kDefaultSize,
+                    uint32_t options = kDefault);
     bool Uninitialize();
     bool Protect(Epoch currentEpoch);
     bool Unprotect(Epoch currentEpoch);
+    bool Online(Epoch current_epoch);
+    bool ProtectInterval(Epoch current_epoch);
+    void CollectReservations(std::vector<Reservation>* reservations);
+    bool QuiescentState(Epoch current_epoch);
 
     Epoch ComputeNewSafeToReclaimEpoch(Epoch currentEpoch);
 
@@ -150,7 +327,12 @@ class EpochManager {
     /// compare-and-swap on the #m_threadId member.
     struct Entry {
       /// Construct an Entry in an unlocked and ready to use state.
-      Entry() : protected_epoch{0}, last_unprotected_epoch{0}, thread_id{0} {}
+      Entry()
+          : protected_epoch{0},
+            last_unprotected_epoch{0},
+            thread_id{0},
+            packed_epoch{nullptr},
+            upper_epoch{0} {}
 
       /// Threads record a snapshot of the global epoch during Protect().
       /// Threads reset this to 0 during Unprotect().
@@ -185,8 +367,17 @@ class EpochManager {
       /// XXX(tzwang): on Linux pthread_t is 64-bit
       std::atomic<uint64_t> thread_id;  //  8 bytes
 
+      /// Slot mirroring #protected_epoch in the packed array scanned by the
+      /// reclaimer; nullptr unless the table was initialized with kPackedScan.
+      std::atomic<Epoch>* packed_epoch;  //  8 bytes
+
+      /// Upper end of the thread's reservation in kIntervalBased mode: the
+      /// latest epoch it read a pointer in. #protected_epoch is the lower
+      /// end; the reservation is void while that is 0.
+      std::atomic<Epoch> upper_epoch;  //  8 bytes
+
       /// Ensure that each Entry is CACHELINE_SIZE.
-      char ___padding[40];
+      char ___padding[24];
 
       // -- Allocation policy to ensure alignment --
 
@@ -225,15 +416,119 @@ class EpochManager {
     static_assert(sizeof(Entry) == CACHELINE_SIZE,
                   "Unexpected table entry size");
 
+    /// Additional entries chained after #table_ once it fills up. Segments are
+    /// only ever appended (with a release store on #next) and are freed in
+    /// Uninitialize(), so ComputeNewSafeToReclaimEpoch() can walk the chain
+    /// while other threads are growing it.
+    struct Segment {
+      Segment(Entry* table, uint64_t size, std::atomic<Epoch>* packed)
+          : table{table}, size{size}, packed{packed}, next{nullptr} {}
+
+      Entry* table;
+      uint64_t size;
+      std::atomic<Epoch>* packed;
+      std::atomic<Segment*> next;
+    };
+
+    /// Body of Protect() once the calling thread's \a entry is known.
+    /// \a asymmetric_fence selects the kAsymmetricFence protocol.
+    static void ProtectEntry(Entry* entry, Epoch current_epoch,
+                             bool asymmetric_fence) {
+      entry->last_unprotected_epoch = 0;
+      if (asymmetric_fence) {
+        // Ordering against the loads that follow is provided by the
+        // reclaimer's membarrier(), see ComputeNewSafeToReclaimEpoch(); we
+        // only have to keep the compiler from sinking the store below them.
+        entry->protected_epoch.store(current_epoch, std::memory_order_relaxed);
+        if (entry->packed_epoch) {
+          entry->packed_epoch->store(current_epoch, std::memory_order_relaxed);
+        }
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        return;
+      }
+      entry->protected_epoch.store(current_epoch, std::memory_order_release);
+      if (entry->packed_epoch) {
+        entry->packed_epoch->store(current_epoch, std::memory_order_release);
+      }
+      // TODO: For this to really make sense according to the spec we
+      // need a (relaxed) load on entry->protected_epoch. What we want to
+      // ensure is that loads "above" this point in this code don't leak down
+      // and access data structures before it is safe.
+      // Consistent with http://preshing.com/20130922/acquire-and-release-fences/
+      // but less clear whether it is consistent with stdc++.
+      // Note the acquire fence emits no instruction on x86, so the store may
+      // still become visible after later loads; kAsymmetricFence closes that
+      // gap without putting an mfence on this path.
+      std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    /// Body of Protect() in kIntervalBased mode once the calling thread's
+    /// \a entry is known. Unlike ProtectEntry() this always ends in a full
+    /// fence: reservations are collected without waiting for an epoch to pass,
+    /// so the reservation must be visible before the first pointer is read,
+    /// or a Scavenge() in the same epoch could free what the thread reads.
+    static void ProtectIntervalEntry(Entry* entry, Epoch current_epoch) {
+      entry->last_unprotected_epoch = 0;
+      entry->upper_epoch.store(current_epoch, std::memory_order_relaxed);
+      entry->protected_epoch.store(current_epoch, std::memory_order_relaxed);
+      if (entry->packed_epoch) {
+        entry->packed_epoch->store(current_epoch, std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    /// Body of ProtectPointer() once the calling thread's \a entry is known.
+    template <typename T>
+    static T* ReadInterval(Entry* entry, const std::atomic<Epoch>& epoch,
+                           const std::atomic<T*>& source) {
+      Epoch upper = entry->upper_epoch.load(std::memory_order_relaxed);
+      for (;;) {
+        T* ptr = source.load(std::memory_order_seq_cst);
+        Epoch current_epoch = epoch.load(std::memory_order_seq_cst);
+        if (current_epoch == upper) return ptr;
+        // The object may have been born after the reservation was last
+        // published; extend it and read again.
+        upper = current_epoch;
+        entry->upper_epoch.store(upper, std::memory_order_seq_cst);
+      }
+    }
+
+    /// Body of Unprotect() once the calling thread's \a entry is known.
+    static void UnprotectEntry(Entry* entry, Epoch current_epoch) {
+      entry->last_unprotected_epoch = current_epoch;
+      std::atomic_thread_fence(std::memory_order_release);
+      entry->protected_epoch.store(0, std::memory_order_relaxed);
+      if (entry->packed_epoch) {
+        entry->packed_epoch->store(0, std::memory_order_relaxed);
+      }
+    }
+
+    bool IsAsymmetricFence() { return asymmetric_fence_; }
+
+    /// Number of tables a thread can cache its entry for. Threads using more
+    /// tables than this fall back to looking their entry up in the table.
+    static const uint32_t kThreadSlots = ThreadSlots::kSlots;
+
    public:
     bool GetEntryForThread(Entry** entry);
     Entry* ReserveEntry(uint64_t startIndex, uint64_t threadId);
     Entry* ReserveEntryForThread();
     void ReleaseEntryForThread();
+    static void ReleaseEntry(void* entry);
     void ReclaimOldEntries();
     bool IsProtected();
 
    private:
+    Entry* FindEntry(uint64_t thread_id);
+    static Entry* ReserveEntryIn(Entry* table, uint64_t size,
+                                 uint64_t start_index, uint64_t thread_id);
+    static Epoch ComputeMinEpochIn(const Entry* table, uint64_t size,
+                                   Epoch oldest_call);
+    static Epoch ComputeMinPackedEpochIn(const std::atomic<Epoch>* packed,
+                                         uint64_t size, Epoch oldest_call);
+    static std::atomic<Epoch>* AllocatePacked(Entry* table, uint64_t size);
+
+   private:
 #ifdef TEST_BUILD
     FRIEND_TEST(EpochManagerTest, Protect);
     FRIEND_TEST(EpochManagerTest, Unprotect);
@@ -247,7 +542,13 @@ class EpochManager {
     FRIEND_TEST(MinEpochTableTest, getEntryForThread_OneSlotFree);
     FRIEND_TEST(MinEpochTableTest, reserveEntryForThread);
     FRIEND_TEST(MinEpochTableTest, reserveEntry);
+    FRIEND_TEST(MinEpochTableTest, GrowWhenFull);
+    FRIEND_TEST(MinEpochTableTest, ReleaseEntryOnThreadExit);
+    FRIEND_TEST(MinEpochTableTest, PackedScan);
+    FRIEND_TEST(MinEpochTableTest, ThreadSlotOverflow);
+    FRIEND_TEST(MinEpochTableTest, ReclaimStaleThreadSlots);
 #endif
+    friend class PerCpuTable;
 
     /// Thread protection status entries. Threads lock entries the first time
     /// the call Protect() (see reserveEntryForThread()). See documentation for
@@ -255,10 +556,232 @@ class EpochManager {
     /// memory-stability.
     Entry* table_;
 
-    /// The number of entries #m_table. Currently, this is fixed after
-    /// Initialize() and never changes or grows. If #m_table runs out
-    /// of entries, then the current implementation will deadlock threads.
+    /// The number of entries #m_table. Fixed after Initialize(); once all of
+    /// them are taken ReclaimOldEntries() chains a new Segment to #segments_.
     uint64_t size_;
+
+    /// Chain of segments appended after #table_, each twice as large as the
+    /// one before it. nullptr until the table first runs out of entries.
+    std::atomic<Segment*> segments_;
+
+    /// Packed mirror of the protected epochs of #table_, padded to a whole
+    /// number of cache lines. nullptr unless initialized with kPackedScan.
+    std::atomic<Epoch>* packed_table_;
+
+    /// Whether the table runs the kAsymmetricFence protocol.
+    bool asymmetric_fence_;
+
+    /// Identifies this table in ThreadSlots, where GetEntryForThread()
+    /// caches the calling thread's entry; acquired on Initialize().
+    uint64_t id_;
+  };
+
+  /// Per-CPU replacement for MinEpochTable (see EpochManager::kPerCpu).
+  /// Instead of one entry per thread, each CPU has a cache line of counters:
+  /// how many times a thread running on it entered and left the protected
+  /// region, split by the parity of the epoch it entered in. Threads find
+  /// their CPU through the rseq area glibc registers for them, so Protect()
+  /// touches a cache line that is local to the current core.
+  ///
+  /// A thread may migrate while protected and leave on another CPU, so only
+  /// the sums across CPUs are meaningful. Readers of epoch e count in bucket
+  /// e & 1. The epoch can only move from e to e + 1 once bucket (e + 1) & 1,
+  /// holding the readers of e - 1, has drained (see IsDrained()); at that
+  /// point only readers of e remain and e - 1 is safe to reclaim. Readers
+  /// therefore never straddle more than two epochs, which is what makes two
+  /// buckets enough.
+  class PerCpuTable {
+   public:
+    /// Counters of one CPU, padded to a cache line.
+    struct Counters {
+      std::atomic<uint64_t> lock[2];
+      std::atomic<uint64_t> unlock[2];
+      char ___padding[32];
+    };
+    static_assert(sizeof(Counters) == MinEpochTable::CACHELINE_SIZE,
+                  "Unexpected per-CPU counter size");
+
+    PerCpuTable() : counters_{nullptr}, cpu_count_{0}, id_{0} {}
+    ~PerCpuTable() { Uninitialize(); }
+
+    bool Initialize();
+    bool Uninitialize();
+
+    /// Enter the protected region in the current epoch, read from
+    /// \a current_epoch. Returns the bucket to pass to Exit().
+    uint32_t Enter(const std::atomic<Epoch>& current_epoch) {
+      for (;;) {
+        Epoch epoch = current_epoch.load(std::memory_order_seq_cst);
+        uint32_t index = epoch & 1;
+        // A locked increment is a full barrier on x86: the epoch re-read below
+        // and every load of the protected region are ordered after it.
+        counters_[CurrentCpu()].lock[index].fetch_add(
+            1, std::memory_order_seq_cst);
+        if (current_epoch.load(std::memory_order_seq_cst) == epoch) {
+          return index;
+        }
+        // The epoch moved under us and the reclaimer might not have waited for
+        // this bucket; back out and count ourselves in the new epoch.
+        counters_[CurrentCpu()].unlock[index].fetch_add(
+            1, std::memory_order_release);
+      }
+    }
+
+    /// Leave the protected region entered with the \a index bucket.
+    void Exit(uint32_t index) {
+      counters_[CurrentCpu()].unlock[index].fetch_add(
+          1, std::memory_order_release);
+    }
+
+    bool Protect(const std::atomic<Epoch>& current_epoch);
+    bool Unprotect();
+    bool IsProtected();
+
+    /// Returns where the calling thread keeps the bucket it entered this
+    /// table with, plus one; zero while unprotected. Stays valid until the
+    /// table is uninitialized.
+    uint64_t* GetStateForThread();
+
+    /// Returns true if no thread is in the protected region through the
+    /// \a index bucket.
+    bool IsDrained(uint32_t index);
+
+    /// The CPU the calling thread is running on, in [0, #cpu_count_).
+    uint32_t CurrentCpu() {
+#if defined(__linux__) && __has_include(<sys/rseq.h>)
+      if (__rseq_size) {
+        auto* rseq_area = reinterpret_cast<volatile struct rseq*>(
+            reinterpret_cast<char*>(__builtin_thread_pointer()) +
+            __rseq_offset);
+        int32_t cpu = rseq_area->cpu_id;
+        if (cpu >= 0) return static_cast<uint32_t>(cpu) % cpu_count_;
+      }
+#endif
+#ifdef __linux__
+      int cpu = sched_getcpu();
+      if (cpu >= 0) return static_cast<uint32_t>(cpu) % cpu_count_;
+#endif
+      return 0;
+    }
+
+   private:
+    /// One Counters per configured CPU.
+    Counters* counters_;
+    uint32_t cpu_count_;
+
+    /// Identifies this table in ThreadSlots, where the calling thread keeps
+    /// the bucket it entered with, plus one; zero while unprotected.
+    uint64_t id_;
+
+    /// Fallback for threads using more tables than they have TLS slots.
+    std::mutex overflow_mutex_;
+    std::unordered_map<uint64_t, uint64_t> overflow_states_;
+  };
+
+  /// A thread's handle on an EpochManager. The thread's entry is looked up
+  /// (or reserved) once on construction, so Protect() and Unprotect() are
+  /// inlined stores on the cached entry with no thread local storage lookup.
+  /// In kPerCpu mode the context caches where the thread keeps its bucket
+  /// instead. Either way the context shares the thread's state with the plain
+  /// API, so the two can be mixed. Must only be used by the thread that
+  /// created it, and not outlive the manager.
+  class ThreadContext {
+   public:
+    explicit ThreadContext(EpochManager* epoch_manager)
+        : epoch_manager_{epoch_manager},
+          entry_{nullptr},
+          per_cpu_table_{epoch_manager->per_cpu_table_},
+          per_cpu_state_{nullptr},
+          asymmetric_fence_{
+              epoch_manager->epoch_table_->IsAsymmetricFence()},
+          quiescent_state_{epoch_manager->quiescent_state_},
+          interval_based_{epoch_manager->interval_based_} {
+      if (per_cpu_table_) {
+        per_cpu_state_ = per_cpu_table_->GetStateForThread();
+      } else {
+        epoch_manager_->epoch_table_->GetEntryForThread(&entry_);
+      }
+    }
+
+    /// See EpochManager::Protect().
+    bool Protect() {
+      if (per_cpu_table_) {
+        *per_cpu_state_ =
+            per_cpu_table_->Enter(epoch_manager_->current_epoch_) + 1;
+        return true;
+      }
+      if (quiescent_state_ &&
+          entry_->protected_epoch.load(std::memory_order_relaxed) != 0) {
+        return true;
+      }
+      Epoch current_epoch =
+          epoch_manager_->current_epoch_.load(std::memory_order_relaxed);
+      if (interval_based_) {
+        MinEpochTable::ProtectIntervalEntry(entry_, current_epoch);
+        return true;
+      }
+      MinEpochTable::ProtectEntry(entry_, current_epoch, asymmetric_fence_);
+      return true;
+    }
+
+    /// See EpochManager::ProtectPointer().
+    template <typename T>
+    T* ProtectPointer(const std::atomic<T*>& source) {
+      return MinEpochTable::ReadInterval(entry_, epoch_manager_->current_epoch_,
+                                         source);
+    }
+
+    /// See EpochManager::Unprotect().
+    bool Unprotect() {
+      if (per_cpu_table_) {
+        if (*per_cpu_state_ == 0) return false;
+        per_cpu_table_->Exit(*per_cpu_state_ - 1);
+        *per_cpu_state_ = 0;
+        return true;
+      }
+      if (quiescent_state_) return true;
+      MinEpochTable::UnprotectEntry(
+          entry_,
+          epoch_manager_->current_epoch_.load(std::memory_order_relaxed));
+      return true;
+    }
+
+    bool IsProtected() {
+      if (per_cpu_table_) {
+        return *per_cpu_state_ != 0;
+      }
+      return entry_->protected_epoch.load(std::memory_order_relaxed) != 0;
+    }
+
+    /// See EpochManager::QuiescentState().
+    bool QuiescentState() {
+      Epoch current_epoch =
+          epoch_manager_->current_epoch_.load(std::memory_order_seq_cst);
+      if (entry_->protected_epoch.load(std::memory_order_relaxed) !=
+          current_epoch) {
+        MinEpochTable::ProtectEntry(entry_, current_epoch, asymmetric_fence_);
+      }
+      return true;
+    }
+
+    /// See EpochManager::ThreadOffline().
+    bool ThreadOffline() {
+      MinEpochTable::UnprotectEntry(
+          entry_,
+          epoch_manager_->current_epoch_.load(std::memory_order_relaxed));
+      return true;
+    }
+
+    EpochManager* GetEpochManager() { return epoch_manager_; }
+
+   private:
+    EpochManager* epoch_manager_;
+    MinEpochTable::Entry* entry_;
+    PerCpuTable* per_cpu_table_;
+    uint64_t* per_cpu_state_;
+    bool asymmetric_fence_;
+    bool quiescent_state_;
+    bool interval_based_;
   };
 
   /// A notion of time for objects that are removed from data structures.
@@ -283,6 +806,56 @@ class EpochManager {
   /// of how early it might have entered. See MinEpochTable for more details.
   MinEpochTable* epoch_table_;
 
+  /// Replaces #epoch_table_ for Protect()/Unprotect() and reclamation in
+  /// kPerCpu mode; nullptr otherwise.
+  PerCpuTable* per_cpu_table_;
+
+  /// Whether the manager runs in kQuiescentState mode.
+  bool quiescent_state_;
+
+  /// Whether the manager runs in kIntervalBased mode.
+  bool interval_based_;
+
+  /// Dedicated thread bumping the epoch, see StartEpochAdvancer(). nullptr
+  /// unless started.
+  std::thread* advancer_;
+
+  /// Whether #advancer_ is (or should keep) running.
+  std::atomic<bool> advancer_running_;
+
+  /// Set by RequestEpochAdvance() to wake #advancer_ before its interval
+  /// elapses; cleared by the advancer once it has bumped the epoch.
+  std::atomic<bool> advance_requested_;
+
+  /// Longest time #advancer_ sleeps between two bumps.
+  std::chrono::microseconds advance_interval_;
+
+  std::mutex advancer_mutex_;
+  std::condition_variable advancer_cv_;
+
+  /// A callback waiting for #epoch to become safe to reclaim.
+  struct PendingCallback {
+    Epoch epoch;
+    GracePeriodCallback callback;
+    void* context;
+  };
+
+  void OnSafeEpochAdvanced();
+  void RunGracePeriodCallbacks(bool all);
+  void WaitForGracePeriodSeq(uint32_t seq, std::chrono::microseconds timeout);
+
+  /// Futex word bumped whenever the safe epoch moves while a Synchronize()
+  /// call is waiting on it; #grace_period_waiters_ counts those calls.
+  std::atomic<uint32_t> grace_period_seq_;
+  std::atomic<uint32_t> grace_period_waiters_;
+
+  /// Callbacks registered with CallAfterGracePeriod(), guarded by
+  /// #grace_period_mutex_. #pending_callbacks_ mirrors their number so the
+  /// bump path only takes the lock when there is work.
+  std::mutex grace_period_mutex_;
+  std::vector<PendingCallback> grace_period_callbacks_;
+  std::atomic<uint64_t> pending_callbacks_;
+
   EpochManager(const EpochManager&) = delete;
   EpochManager(EpochManager&&) = delete;
   EpochManager& operator=(EpochManager&&) = delete;
@@ -333,7 +906,19 @@ class EpochGuard {
 };
 
 EpochManager::EpochManager()
-    : current_epoch_{1}, safe_to_reclaim_epoch_{0}, epoch_table_{nullptr} {}
+    : current_epoch_{1},
+      safe_to_reclaim_epoch_{0},
+      epoch_table_{nullptr},
+      per_cpu_table_{nullptr},
+      quiescent_state_{false},
+      interval_based_{false},
+      advancer_{nullptr},
+      advancer_running_{false},
+      advance_requested_{false},
+      advance_interval_{0},
+      grace_period_seq_{0},
+      grace_period_waiters_{0},
+      pending_callbacks_{0} {}
 
 EpochManager::~EpochManager() { Uninitialize(); }
 
@@ -347,18 +932,36 @@ EpochManager::~EpochManager() { Uninitialize(); }
  * \retval E_OUTOFMEMORY Initialization failed due to lack of heap space, the
  *      instance was left safely in an uninitialized state.
  */
-bool EpochManager::Initialize() {
+bool EpochManager::Initialize(uint32_t options) {
   if (epoch_table_) return true;
+  if ((options & kPerCpu) && (options & kQuiescentState)) return false;
+  if ((options & kIntervalBased) &&
+      (options & (kPerCpu | kQuiescentState))) {
+    return false;
+  }
 
   MinEpochTable* new_table = new MinEpochTable();
 
   if (new_table == nullptr) return false;
 
-  auto rv = new_table->Initialize();
+  auto rv = new_table->Initialize(MinEpochTable::kDefaultSize, options);
   if (!rv) return rv;
 
+  if (options & kPerCpu) {
+    PerCpuTable* per_cpu_table = new PerCpuTable();
+    if (!per_cpu_table->Initialize()) {
+      delete per_cpu_table;
+      new_table->Uninitialize();
+      delete new_table;
+      return false;
+    }
+    per_cpu_table_ = per_cpu_table;
+  }
+
   current_epoch_ = 1;
   safe_to_reclaim_epoch_ = 0;
+  quiescent_state_ = options & kQuiescentState;
+  interval_based_ = options & kIntervalBased;
   epoch_table_ = new_table;
 
   return true;
@@ -384,12 +987,21 @@ bool EpochManager::Initialize() {
 bool EpochManager::Uninitialize() {
   if (!epoch_table_) return true;
 
+  StopEpochAdvancer();
+
+  // Nobody is protected any more, so every grace period is over.
+  RunGracePeriodCallbacks(true);
+
   auto s = epoch_table_->Uninitialize();
 
   // Keep going anyway. Even if the inner table fails to completely
   // clean up we want to clean up as much as possible.
   delete epoch_table_;
   epoch_table_ = nullptr;
+  delete per_cpu_table_;
+  per_cpu_table_ = nullptr;
+  quiescent_state_ = false;
+  interval_based_ = false;
   current_epoch_ = 1;
   safe_to_reclaim_epoch_ = 0;
 
@@ -408,13 +1020,83 @@ bool EpochManager::Uninitialize() {
  * performance, since it is an atomic operation and invalidates a read-hot
  * object in the cache of all of the cores.
  *
- * Only called by GarbageList.
+ * Only called by GarbageList (through RequestEpochAdvance()) and the
+ * advancer thread.
  */
 void EpochManager::BumpCurrentEpoch() {
+  if (per_cpu_table_) {
+    // Only move on once the readers of the previous epoch have left, see
+    // PerCpuTable. Then nobody entered before the current epoch is left.
+    Epoch current = current_epoch_.load(std::memory_order_seq_cst);
+    if (!per_cpu_table_->IsDrained((current + 1) & 1)) return;
+    Epoch safe = safe_to_reclaim_epoch_.load(std::memory_order_relaxed);
+    bool advanced = false;
+    while (safe < current - 1 && !advanced) {
+      advanced = safe_to_reclaim_epoch_.compare_exchange_weak(
+          safe, current - 1, std::memory_order_release);
+    }
+    current_epoch_.compare_exchange_strong(current, current + 1,
+                                           std::memory_order_seq_cst);
+    if (advanced) OnSafeEpochAdvanced();
+    return;
+  }
   Epoch newEpoch = current_epoch_.fetch_add(1, std::memory_order_seq_cst);
   ComputeNewSafeToReclaimEpoch(newEpoch);
 }
 
+/**
+ * Start a thread that bumps the epoch, and thereby refreshes
+ * #safe_to_reclaim_epoch_, at least every \a interval_us microseconds, and
+ * right away whenever RequestEpochAdvance() is called. This takes the
+ * ComputeNewSafeToReclaimEpoch() scan off the GarbageList::Push() path and
+ * bounds how long reclamation can lag behind even when pushes are rare.
+ *
+ * \retval true The advancer is running (or already was).
+ * \retval false The manager is not initialized or \a interval_us is zero.
+ */
+bool EpochManager::StartEpochAdvancer(uint64_t interval_us) {
+  if (!epoch_table_ || !interval_us) return false;
+  std::unique_lock<std::mutex> lock(advancer_mutex_);
+  if (advancer_) return true;
+
+  advance_interval_ = std::chrono::microseconds(interval_us);
+  advance_requested_ = false;
+  advancer_running_ = true;
+  advancer_ = new std::thread([this]() {
+    std::unique_lock<std::mutex> lock(advancer_mutex_);
+    while (advancer_running_.load(std::memory_order_relaxed)) {
+      advancer_cv_.wait_for(lock, advance_interval_, [this]() {
+        return advance_requested_.load(std::memory_order_relaxed) ||
+               !advancer_running_.load(std::memory_order_relaxed);
+      });
+      if (!advancer_running_.load(std::memory_order_relaxed)) break;
+      advance_requested_.store(false, std::memory_order_relaxed);
+      lock.unlock();
+      BumpCurrentEpoch();
+      lock.lock();
+    }
+  });
+  return true;
+}
+
+/**
+ * Stop and join the advancer thread, if any. From then on
+ * RequestEpochAdvance() bumps the epoch inline again.
+ */
+void EpochManager::StopEpochAdvancer() {
+  std::thread* advancer = nullptr;
+  {
+    std::unique_lock<std::mutex> lock(advancer_mutex_);
+    advancer = advancer_;
+    advancer_ = nullptr;
+    advancer_running_ = false;
+  }
+  if (!advancer) return;
+  advancer_cv_.notify_all();
+  advancer->join();
+  delete advancer;
+}
+
 // - private -
 
 /**
@@ -428,13 +1110,131 @@ void EpochManager::BumpCurrentEpoch() {
 void EpochManager::ComputeNewSafeToReclaimEpoch(Epoch currentEpoch) {
   safe_to_reclaim_epoch_.store(
       epoch_table_->ComputeNewSafeToReclaimEpoch(currentEpoch),
-      std::memory_order_release);
+      std::memory_order_seq_cst);
+  OnSafeEpochAdvanced();
+}
+
+/**
+ * Wake Synchronize() callers and run the grace period callbacks that became
+ * ready. Both checks are a single load when nobody is waiting.
+ */
+void EpochManager::OnSafeEpochAdvanced() {
+  // Pairs with the increment in Synchronize(): either the waiter sees the new
+  // safe epoch before sleeping, or we see the waiter and wake it.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (grace_period_waiters_.load(std::memory_order_relaxed)) {
+    grace_period_seq_.fetch_add(1, std::memory_order_seq_cst);
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&grace_period_seq_),
+            FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#endif
+  }
+  if (pending_callbacks_.load(std::memory_order_relaxed)) {
+    RunGracePeriodCallbacks(false);
+  }
+}
+
+/// Run the registered callbacks whose epoch is safe to reclaim, or all of
+/// them if \a all is set. Callbacks run outside the lock.
+void EpochManager::RunGracePeriodCallbacks(bool all) {
+  std::vector<PendingCallback> ready;
+  {
+    std::unique_lock<std::mutex> lock(grace_period_mutex_);
+    auto waiting = std::partition(
+        grace_period_callbacks_.begin(), grace_period_callbacks_.end(),
+        [this, all](const PendingCallback& pending) {
+          return !all && !IsSafeToReclaim(pending.epoch);
+        });
+    ready.assign(waiting, grace_period_callbacks_.end());
+    grace_period_callbacks_.erase(waiting, grace_period_callbacks_.end());
+    pending_callbacks_.fetch_sub(ready.size(), std::memory_order_relaxed);
+  }
+  for (auto& pending : ready) {
+    pending.callback(pending.context);
+  }
+}
+
+bool EpochManager::Synchronize() {
+  if (!epoch_table_ || IsProtected()) return false;
+
+  Epoch target = GetCurrentEpoch();
+  if (IsSafeToReclaim(target)) return true;
+
+  // Readers do not signal when they leave, so sleep with a timeout and nudge
+  // the epoch forward again on wake-up; back off while readers linger.
+  auto timeout = std::chrono::microseconds(50);
+  const auto max_timeout = std::chrono::microseconds(10 * 1000);
+  grace_period_waiters_.fetch_add(1, std::memory_order_seq_cst);
+  for (;;) {
+    uint32_t seq = grace_period_seq_.load(std::memory_order_seq_cst);
+    RequestEpochAdvance();
+    if (IsSafeToReclaim(target)) break;
+    WaitForGracePeriodSeq(seq, timeout);
+    if (IsSafeToReclaim(target)) break;
+    timeout = std::min(timeout * 2, max_timeout);
+  }
+  grace_period_waiters_.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool EpochManager::WaitForEpochAdvance(std::chrono::microseconds timeout) {
+  if (!epoch_table_) return false;
+
+  Epoch safe = safe_to_reclaim_epoch_.load(std::memory_order_seq_cst);
+  grace_period_waiters_.fetch_add(1, std::memory_order_seq_cst);
+  uint32_t seq = grace_period_seq_.load(std::memory_order_seq_cst);
+  RequestEpochAdvance();
+  if (safe_to_reclaim_epoch_.load(std::memory_order_seq_cst) == safe) {
+    WaitForGracePeriodSeq(seq, timeout);
+  }
+  grace_period_waiters_.fetch_sub(1, std::memory_order_relaxed);
+  return safe_to_reclaim_epoch_.load(std::memory_order_seq_cst) != safe;
+}
+
+/// Sleep until #grace_period_seq_ no longer reads \a seq, or \a timeout
+/// passes. The caller must be counted in #grace_period_waiters_.
+void EpochManager::WaitForGracePeriodSeq(uint32_t seq,
+                                         std::chrono::microseconds timeout) {
+#ifdef __linux__
+  auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+  struct timespec wait_time {
+    static_cast<time_t>(seconds.count()),
+        static_cast<long>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(timeout -
+                                                                 seconds)
+                .count())
+  };
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&grace_period_seq_),
+          FUTEX_WAIT_PRIVATE, seq, &wait_time, nullptr, 0);
+#else
+  (void)seq;
+  std::this_thread::sleep_for(timeout);
+#endif
+}
+
+bool EpochManager::CallAfterGracePeriod(GracePeriodCallback callback,
+                                        void* context) {
+  if (!epoch_table_ || !callback) return false;
+  {
+    std::unique_lock<std::mutex> lock(grace_period_mutex_);
+    grace_period_callbacks_.push_back(
+        PendingCallback{GetCurrentEpoch(), callback, context});
+    pending_callbacks_.fetch_add(1, std::memory_order_relaxed);
+  }
+  RequestEpochAdvance();
+  return true;
 }
 
 // --- EpochManager::MinEpochTable ---
 
 /// Create an uninitialized table.
-EpochManager::MinEpochTable::MinEpochTable() : table_{nullptr}, size_{} {}
+EpochManager::MinEpochTable::MinEpochTable()
+    : table_{nullptr},
+      size_{},
+      segments_{nullptr},
+      packed_table_{nullptr},
+      asymmetric_fence_{false},
+      id_{0} {}
 
 /**
  * Initialize an uninitialized table. This method must be used before
@@ -449,10 +1249,13 @@ EpochManager::MinEpochTable::MinEpochTable() : table_{nullptr}, size_{} {}
  *       If this number is too large it may slow down threads performing
  *       space reclamation, since this table must be scanned occasionally to
  *       make progress.
- * TODO(stutsman) Table growing and entry reclamation are not yet implemented.
- * Currently, the manager supports precisely size distinct threads over the
- * lifetime of the manager until it begins permanently spinning in all calls to
- * Protect().
+ * \param options EpochManager::Options. With kPackedScan the table keeps a
+ *       packed mirror of the protected epochs and computes their minimum with
+ *       AVX-512/AVX2 in ComputeNewSafeToReclaimEpoch(). With kAsymmetricFence
+ *       it registers for expedited membarrier, see EpochManager::Options.
+ * Entries of threads that exit through Thread::join() are handed back to the
+ * table; when every entry is taken by a live thread the table grows by
+ * chaining another Segment (see ReclaimOldEntries()).
  *
  * \retval S_OK Initialization was successful and instance is ready for use.
  * \retval S_FALSE Instance was already initialized; instance is ready for use.
@@ -462,7 +1265,7 @@ EpochManager::MinEpochTable::MinEpochTable() : table_{nullptr}, size_{} {}
  * \retval HRESULT_FROM_WIN32(TLS_OUT_OF_INDEXES) Initialization failed because
  *       TlsAlloc() failed; the table was safely left in an uninitialized state.
  */
-bool EpochManager::MinEpochTable::Initialize(uint64_t size) {
+bool EpochManager::MinEpochTable::Initialize(uint64_t size, uint32_t options) {
   if (table_) return true;
 
   if (!IS_POWER_OF_TWO(size)) return false;
@@ -476,8 +1279,32 @@ bool EpochManager::MinEpochTable::Initialize(uint64_t size) {
             "table is not cacheline aligned");
 #endif
 
+  asymmetric_fence_ = false;
+  if (options & kAsymmetricFence) {
+#ifdef __linux__
+    long supported = syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0);
+    asymmetric_fence_ =
+        supported > 0 && (supported & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+        syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED,
+                0) == 0;
+#endif
+#ifdef TEST_BUILD
+    LOG_IF(WARNING, !asymmetric_fence_)
+        << "expedited membarrier unavailable, using fences" << std::endl;
+#endif
+  }
+
+  if (options & kPackedScan) {
+    packed_table_ = AllocatePacked(new_table, size);
+    if (!packed_table_) {
+      delete[] new_table;
+      return false;
+    }
+  }
+
   table_ = new_table;
   size_ = size;
+  id_ = ThreadSlots::AcquireOwner();
 
   return true;
 }
@@ -502,9 +1329,27 @@ bool EpochManager::MinEpochTable::Initialize(uint64_t size) {
 bool EpochManager::MinEpochTable::Uninitialize() {
   if (!table_) return true;
 
+  // Drop the cached entries, and make sure no thread exiting later hands an
+  // entry back into freed memory.
+  ThreadSlots::ReleaseOwner(id_);
+  Thread::UnregisterTlsInRange(table_, table_ + size_);
+
+  Segment* segment = segments_.load(std::memory_order_acquire);
+  while (segment) {
+    Thread::UnregisterTlsInRange(segment->table, segment->table + segment->size);
+    Segment* next = segment->next.load(std::memory_order_relaxed);
+    delete[] segment->table;
+    free(segment->packed);
+    delete segment;
+    segment = next;
+  }
+  segments_.store(nullptr, std::memory_order_relaxed);
+
   size_ = 0;
   delete[] table_;
   table_ = nullptr;
+  free(packed_table_);
+  packed_table_ = nullptr;
 
   return true;
 }
@@ -532,19 +1377,7 @@ bool EpochManager::MinEpochTable::Protect(Epoch current_epoch) {
     return false;
   }
 
-  entry->last_unprotected_epoch = 0;
-#if 1
-  entry->protected_epoch.store(current_epoch, std::memory_order_release);
-  // TODO: For this to really make sense according to the spec we
-  // need a (relaxed) load on entry->protected_epoch. What we want to
-  // ensure is that loads "above" this point in this code don't leak down
-  // and access data structures before it is safe.
-  // Consistent with http://preshing.com/20130922/acquire-and-release-fences/
-  // but less clear whether it is consistent with stdc++.
-  std::atomic_thread_fence(std::memory_order_acquire);
-#else
-  entry->m_protectedEpoch.exchange(currentEpoch, std::memory_order_acq_rel);
-#endif
+  ProtectEntry(entry, current_epoch, asymmetric_fence_);
   return true;
 }
 
@@ -577,9 +1410,7 @@ bool EpochManager::MinEpochTable::Unprotect(Epoch currentEpoch) {
       << "; pthread_self():" << pthread_self() << std::endl;
 #endif
 
-  entry->last_unprotected_epoch = currentEpoch;
-  std::atomic_thread_fence(std::memory_order_release);
-  entry->protected_epoch.store(0, std::memory_order_relaxed);
+  UnprotectEntry(entry, currentEpoch);
   return true;
 }
 
@@ -602,9 +1433,41 @@ bool EpochManager::MinEpochTable::Unprotect(Epoch currentEpoch) {
  */
 Epoch EpochManager::MinEpochTable::ComputeNewSafeToReclaimEpoch(
     Epoch current_epoch) {
-  Epoch oldest_call = current_epoch;
-  for (uint64_t i = 0; i < size_; ++i) {
-    Entry& entry = table_[i];
+#ifdef __linux__
+  if (asymmetric_fence_) {
+    // Pairs with the compiler-only barrier in ProtectEntry(): once this
+    // returns, every thread has executed a full barrier, so any Protect()
+    // that is ordered before its subsequent loads is visible to the scan.
+    syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+  }
+#endif
+  if (packed_table_) {
+    Epoch oldest_call =
+        ComputeMinPackedEpochIn(packed_table_, size_, current_epoch);
+    for (Segment* segment = segments_.load(std::memory_order_acquire); segment;
+         segment = segment->next.load(std::memory_order_acquire)) {
+      oldest_call =
+          ComputeMinPackedEpochIn(segment->packed, segment->size, oldest_call);
+    }
+    return oldest_call - 1;
+  }
+
+  Epoch oldest_call = ComputeMinEpochIn(table_, size_, current_epoch);
+  for (Segment* segment = segments_.load(std::memory_order_acquire); segment;
+       segment = segment->next.load(std::memory_order_acquire)) {
+    oldest_call = ComputeMinEpochIn(segment->table, segment->size, oldest_call);
+  }
+  // The latest safe epoch is the one just before the earlier unsafe one.
+  return oldest_call - 1;
+}
+
+/// Returns the smaller of \a oldest_call and the oldest protected epoch found
+/// in the \a size entries of \a table.
+Epoch EpochManager::MinEpochTable::ComputeMinEpochIn(const Entry* table,
+                                                     uint64_t size,
+                                                     Epoch oldest_call) {
+  for (uint64_t i = 0; i < size; ++i) {
+    const Entry& entry = table[i];
     // If any other thread has flushed a protected epoch to the cache
     // hierarchy we're guaranteed to see it even with relaxed access.
     Epoch entryEpoch = entry.protected_epoch.load(std::memory_order_acquire);
@@ -612,8 +1475,77 @@ Epoch EpochManager::MinEpochTable::ComputeNewSafeToReclaimEpoch(
       oldest_call = entryEpoch;
     }
   }
-  // The latest safe epoch is the one just before the earlier unsafe one.
-  return oldest_call - 1;
+  return oldest_call;
+}
+
+/// Same as ComputeMinEpochIn(), but over the packed mirror of a table. Zero
+/// (unprotected) must not win the minimum, so we subtract one from every epoch
+/// first, which wraps zero around to the largest unsigned value. \a size is
+/// rounded up to whole cache lines; AllocatePacked() zeroes the padding.
+///
+/// Vector loads are not atomic as a whole, but each aligned 8-byte lane is,
+/// which is all the scan needs: like the scalar loop, it only needs to observe
+/// every epoch published before the scan started.
+Epoch EpochManager::MinEpochTable::ComputeMinPackedEpochIn(
+    const std::atomic<Epoch>* packed, uint64_t size, Epoch oldest_call) {
+  const Epoch* epochs = reinterpret_cast<const Epoch*>(packed);
+  uint64_t padded = (size + 7) & ~7llu;
+  std::atomic_thread_fence(std::memory_order_acquire);
+#if defined(__AVX512F__)
+  const __m512i one = _mm512_set1_epi64(1);
+  __m512i min = _mm512_set1_epi64(-1);
+  for (uint64_t i = 0; i < padded; i += 8) {
+    __m512i v = _mm512_load_si512(reinterpret_cast<const void*>(epochs + i));
+    min = _mm512_min_epu64(min, _mm512_sub_epi64(v, one));
+  }
+  uint64_t smallest = _mm512_reduce_min_epu64(min);
+#elif defined(__AVX2__)
+  // No unsigned 64-bit min in AVX2; flip the sign bit so that signed compares
+  // order the lanes as unsigned.
+  const __m256i bias = _mm256_set1_epi64x(1 - 0x8000000000000000ll);
+  __m256i min = _mm256_set1_epi64x(0x7fffffffffffffffll);
+  for (uint64_t i = 0; i < padded; i += 4) {
+    __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(epochs + i));
+    v = _mm256_sub_epi64(v, bias);
+    min = _mm256_blendv_epi8(min, v, _mm256_cmpgt_epi64(min, v));
+  }
+  alignas(32) int64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), min);
+  int64_t signed_smallest = lanes[0];
+  for (int i = 1; i < 4; ++i) {
+    if (lanes[i] < signed_smallest) signed_smallest = lanes[i];
+  }
+  uint64_t smallest = static_cast<uint64_t>(signed_smallest) ^ (1llu << 63);
+#else
+  uint64_t smallest = ~0llu;
+  for (uint64_t i = 0; i < padded; ++i) {
+    if (epochs[i] - 1 < smallest) smallest = epochs[i] - 1;
+  }
+#endif
+  // ~0 means every entry was unprotected.
+  if (smallest != ~0llu && smallest + 1 < oldest_call) {
+    oldest_call = smallest + 1;
+  }
+  return oldest_call;
+}
+
+/// Allocate the packed mirror for the \a size entries of \a table and point
+/// each entry at its slot.
+std::atomic<Epoch>* EpochManager::MinEpochTable::AllocatePacked(
+    Entry* table, uint64_t size) {
+  uint64_t padded = (size + 7) & ~7llu;
+  void* mem = nullptr;
+  if (posix_memalign(&mem, CACHELINE_SIZE, padded * sizeof(Epoch))) {
+    return nullptr;
+  }
+  std::atomic<Epoch>* packed = reinterpret_cast<std::atomic<Epoch>*>(mem);
+  for (uint64_t i = 0; i < padded; ++i) {
+    new (&packed[i]) std::atomic<Epoch>(0);
+  }
+  for (uint64_t i = 0; i < size; ++i) {
+    table[i].packed_epoch = &packed[i];
+  }
+  return packed;
 }
 
 // - private -
@@ -635,22 +1567,60 @@ Epoch EpochManager::MinEpochTable::ComputeNewSafeToReclaimEpoch(
  *      a non-serviceable state.
  */
 bool EpochManager::MinEpochTable::GetEntryForThread(Entry** entry) {
-  thread_local Entry* tls = nullptr;
-  if (tls) {
-    *entry = tls;
+  ThreadSlots::Slot* slot = ThreadSlots::Find(id_);
+  if (slot) {
+    *entry = reinterpret_cast<Entry*>(slot->value);
     return true;
   }
 
-  // No entry index was found in TLS, so we need to reserve a new entry
-  // and record its index in TLS
-  Entry* reserved = ReserveEntryForThread();
-  tls = *entry = reserved;
+  slot = ThreadSlots::Claim(id_);
+  if (!slot) {
+    // This thread uses more tables than it can cache; the entry might have
+    // been reserved already, without being cached.
+    Entry* found = FindEntry(pthread_self());
+    if (found) {
+      *entry = found;
+      return true;
+    }
+  }
 
-  Thread::RegisterTls((uint64_t*)&tls, (uint64_t) nullptr);
+  // No entry was found in TLS, so we need to reserve a new entry
+  // and record it in TLS
+  Entry* reserved = ReserveEntryForThread();
+  *entry = reserved;
+
+  // Hand the entry back to the table once the thread is joined, so exited
+  // threads don't pin slots forever.
+  uint64_t* tls = nullptr;
+  if (slot) {
+    slot->value = reinterpret_cast<uint64_t>(reserved);
+    tls = &slot->owner;
+  }
+  Thread::RegisterTls(tls, 0, &MinEpochTable::ReleaseEntry, reserved);
 
   return true;
 }
 
+/// Returns the entry reserved by \a thread_id, or nullptr if it holds none.
+EpochManager::MinEpochTable::Entry* EpochManager::MinEpochTable::FindEntry(
+    uint64_t thread_id) {
+  for (uint64_t i = 0; i < size_; ++i) {
+    if (table_[i].thread_id.load(std::memory_order_relaxed) == thread_id) {
+      return &table_[i];
+    }
+  }
+  for (Segment* segment = segments_.load(std::memory_order_acquire); segment;
+       segment = segment->next.load(std::memory_order_acquire)) {
+    for (uint64_t i = 0; i < segment->size; ++i) {
+      if (segment->table[i].thread_id.load(std::memory_order_relaxed) ==
+          thread_id) {
+        return &segment->table[i];
+      }
+    }
+  }
+  return nullptr;
+}
+
 uint32_t Murmur3(uint32_t h) {
   h ^= h >> 16;
   h *= 0x85ebca6b;
@@ -681,26 +1651,120 @@ EpochManager::MinEpochTable::Entry* EpochManager::MinEpochTable::ReserveEntry(
     uint64_t start_index, uint64_t thread_id) {
   for (;;) {
     // Reserve an entry in the table.
-    for (uint64_t i = 0; i < size_; ++i) {
-      uint64_t indexToTest = (start_index + i) & (size_ - 1);
-      Entry& entry = table_[indexToTest];
-      if (entry.thread_id == 0) {
-        uint64_t expected = 0;
-        // Atomically grab a slot. No memory barriers needed.
-        // Once the threadId is in place the slot is locked.
-        bool success = entry.thread_id.compare_exchange_strong(
-            expected, thread_id, std::memory_order_relaxed);
-        if (success) {
-          return &table_[indexToTest];
-        }
-        // Ignore the CAS failure since the entry must be populated,
-        // just move on to the next entry.
+    Entry* entry = ReserveEntryIn(table_, size_, start_index, thread_id);
+    if (entry) {
+      return entry;
+    }
+    for (Segment* segment = segments_.load(std::memory_order_acquire); segment;
+         segment = segment->next.load(std::memory_order_acquire)) {
+      entry = ReserveEntryIn(segment->table, segment->size, start_index,
+                             thread_id);
+      if (entry) {
+        return entry;
       }
     }
     ReclaimOldEntries();
   }
 }
 
+/// Try to lock one of the \a size entries of \a table for \a thread_id,
+/// probing linearly from \a start_index. Returns nullptr if all are taken.
+EpochManager::MinEpochTable::Entry*
+EpochManager::MinEpochTable::ReserveEntryIn(Entry* table, uint64_t size,
+                                            uint64_t start_index,
+                                            uint64_t thread_id) {
+  for (uint64_t i = 0; i < size; ++i) {
+    uint64_t indexToTest = (start_index + i) & (size - 1);
+    Entry& entry = table[indexToTest];
+    if (entry.thread_id == 0) {
+      uint64_t expected = 0;
+      // Atomically grab a slot. No memory barriers needed.
+      // Once the threadId is in place the slot is locked.
+      bool success = entry.thread_id.compare_exchange_strong(
+          expected, thread_id, std::memory_order_relaxed);
+      if (success) {
+        return &table[indexToTest];
+      }
+      // Ignore the CAS failure since the entry must be populated,
+      // just move on to the next entry.
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * Protect() in kQuiescentState mode: enter the thread into the table at
+ * \a current_epoch unless it is already online, in which case this only
+ * reads the thread's own entry.
+ */
+bool EpochManager::MinEpochTable::Online(Epoch current_epoch) {
+  Entry* entry = nullptr;
+  if (!GetEntryForThread(&entry)) {
+    return false;
+  }
+
+  if (entry->protected_epoch.load(std::memory_order_relaxed) == 0) {
+    ProtectEntry(entry, current_epoch, asymmetric_fence_);
+  }
+  return true;
+}
+
+/**
+ * Announce a quiescent state: the calling thread has dropped every pointer it
+ * obtained before \a current_epoch was read. Skips the store if the thread
+ * already announced this epoch, so calling this more often than the epoch
+ * moves costs no cache line transfers.
+ */
+bool EpochManager::MinEpochTable::QuiescentState(Epoch current_epoch) {
+  Entry* entry = nullptr;
+  if (!GetEntryForThread(&entry)) {
+    return false;
+  }
+
+  if (entry->protected_epoch.load(std::memory_order_relaxed) != current_epoch) {
+    ProtectEntry(entry, current_epoch, asymmetric_fence_);
+  }
+  return true;
+}
+
+/**
+ * Protect() in kIntervalBased mode: open a reservation covering only
+ * \a current_epoch.
+ */
+bool EpochManager::MinEpochTable::ProtectInterval(Epoch current_epoch) {
+  Entry* entry = nullptr;
+  if (!GetEntryForThread(&entry)) {
+    return false;
+  }
+
+  ProtectIntervalEntry(entry, current_epoch);
+  return true;
+}
+
+/**
+ * Append the reservation of every protected thread to \a reservations. The
+ * lower end is read before the upper end, so a thread that leaves and
+ * re-enters concurrently shows up with a wider interval than it actually
+ * has, never a narrower one.
+ */
+void EpochManager::MinEpochTable::CollectReservations(
+    std::vector<Reservation>* reservations) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto collect = [reservations](const Entry* table, uint64_t size) {
+    for (uint64_t i = 0; i < size; ++i) {
+      Epoch lower = table[i].protected_epoch.load(std::memory_order_acquire);
+      if (lower == 0) continue;
+      Epoch upper = table[i].upper_epoch.load(std::memory_order_acquire);
+      reservations->push_back(Reservation{lower, std::max(lower, upper)});
+    }
+  };
+  collect(table_, size_);
+  for (Segment* segment = segments_.load(std::memory_order_acquire); segment;
+       segment = segment->next.load(std::memory_order_acquire)) {
+    collect(segment->table, segment->size);
+  }
+}
+
 bool EpochManager::MinEpochTable::IsProtected() {
   Entry* entry = nullptr;
   auto s = GetEntryForThread(&entry);
@@ -711,6 +1775,184 @@ bool EpochManager::MinEpochTable::IsProtected() {
   return entry->protected_epoch.load(std::memory_order_relaxed) != 0;
 }
 
-void EpochManager::MinEpochTable::ReleaseEntryForThread() {}
+/**
+ * Give the calling thread's entry back to the table. The thread must be
+ * unprotected; its next Protect() reserves a fresh entry.
+ */
+void EpochManager::MinEpochTable::ReleaseEntryForThread() {
+  ThreadSlots::Slot* slot = ThreadSlots::Find(id_);
+  if (slot) {
+    Entry* entry = reinterpret_cast<Entry*>(slot->value);
+    Thread::UnregisterTls(&slot->owner, entry);
+    *slot = ThreadSlots::Slot{};
+    ReleaseEntry(entry);
+    return;
+  }
+  Entry* entry = FindEntry(pthread_self());
+  if (entry) {
+    Thread::UnregisterTls(nullptr, entry);
+    ReleaseEntry(entry);
+  }
+}
+
+/**
+ * Unlock \a entry so that another thread can reserve it. Registered as the
+ * Thread exit callback of every reserved entry; at that point the owning thread
+ * is gone, so nobody else can be writing to the entry.
+ */
+void EpochManager::MinEpochTable::ReleaseEntry(void* entry) {
+  Entry* e = reinterpret_cast<Entry*>(entry);
+  e->protected_epoch.store(0, std::memory_order_relaxed);
+  if (e->packed_epoch) {
+    e->packed_epoch->store(0, std::memory_order_relaxed);
+  }
+  e->upper_epoch.store(0, std::memory_order_relaxed);
+  e->last_unprotected_epoch = 0;
+  // Publish the cleared epochs before the slot can be reserved again.
+  e->thread_id.store(0, std::memory_order_release);
+}
+
+/**
+ * Called by ReserveEntry() when every entry is taken. Entries of exited threads
+ * have already been handed back by ReleaseEntry(), so the remaining ones belong
+ * to live threads and we make room by appending a Segment twice the size of the
+ * last one. Threads racing to grow the table agree on a single new segment by
+ * CAS-ing the tail link; losers free theirs and retry the reservation.
+ */
+void EpochManager::MinEpochTable::ReclaimOldEntries() {
+  std::atomic<Segment*>* link = &segments_;
+  uint64_t last_size = size_;
+  Segment* tail = link->load(std::memory_order_acquire);
+  while (tail) {
+    last_size = tail->size;
+    link = &tail->next;
+    tail = link->load(std::memory_order_acquire);
+  }
+
+  Entry* new_table = new Entry[last_size * 2];
+  if (!new_table) return;
+  std::atomic<Epoch>* packed = nullptr;
+  if (packed_table_) {
+    packed = AllocatePacked(new_table, last_size * 2);
+    if (!packed) {
+      delete[] new_table;
+      return;
+    }
+  }
+  Segment* segment = new Segment(new_table, last_size * 2, packed);
+
+  Segment* expected = nullptr;
+  if (!link->compare_exchange_strong(expected, segment,
+                                     std::memory_order_release)) {
+    delete[] new_table;
+    free(packed);
+    delete segment;
+  }
+}
+
+// --- EpochManager::PerCpuTable ---
+
+/**
+ * Allocate one cache line of counters per configured CPU. Calling this on an
+ * initialized table has no effect.
+ */
+bool EpochManager::PerCpuTable::Initialize() {
+  if (counters_) return true;
+
+#ifdef __linux__
+  int cpus = get_nprocs_conf();
+#else
+  int cpus = std::thread::hardware_concurrency();
+#endif
+  uint32_t cpu_count = cpus > 0 ? cpus : 1;
+
+  void* mem = nullptr;
+  if (posix_memalign(&mem, MinEpochTable::CACHELINE_SIZE,
+                     sizeof(Counters) * cpu_count)) {
+    return false;
+  }
+  counters_ = reinterpret_cast<Counters*>(mem);
+  for (uint32_t i = 0; i < cpu_count; ++i) {
+    new (&counters_[i]) Counters{};
+  }
+  cpu_count_ = cpu_count;
+  id_ = ThreadSlots::AcquireOwner();
+  return true;
+}
+
+/**
+ * Release the counters. The caller guarantees no thread is protected.
+ */
+bool EpochManager::PerCpuTable::Uninitialize() {
+  if (!counters_) return true;
+  ThreadSlots::ReleaseOwner(id_);
+  free(counters_);
+  counters_ = nullptr;
+  cpu_count_ = 0;
+  overflow_states_.clear();
+  return true;
+}
+
+/**
+ * Returns where the calling thread keeps its bucket for this table: a TLS slot
+ * if one is available, the (locked) overflow map otherwise.
+ */
+uint64_t* EpochManager::PerCpuTable::GetStateForThread() {
+  ThreadSlots::Slot* slot = ThreadSlots::Find(id_);
+  if (slot) return &slot->value;
+  slot = ThreadSlots::Claim(id_);
+  if (slot) {
+    Thread::RegisterTls(&slot->owner, 0);
+    return &slot->value;
+  }
+  std::unique_lock<std::mutex> lock(overflow_mutex_);
+  // Node-based map: the address stays valid until this thread's entry is
+  // erased, which only Uninitialize() does.
+  return &overflow_states_[pthread_self()];
+}
 
-void EpochManager::MinEpochTable::ReclaimOldEntries() {}
+/**
+ * Enter the protected region, remembering the bucket in thread local storage.
+ * See EpochManager::Protect().
+ */
+bool EpochManager::PerCpuTable::Protect(
+    const std::atomic<Epoch>& current_epoch) {
+  uint64_t* state = GetStateForThread();
+  *state = Enter(current_epoch) + 1;
+  return true;
+}
+
+/**
+ * Leave the protected region. See EpochManager::Unprotect().
+ */
+bool EpochManager::PerCpuTable::Unprotect() {
+  uint64_t* state = GetStateForThread();
+  if (*state == 0) return false;
+  Exit(*state - 1);
+  *state = 0;
+  return true;
+}
+
+bool EpochManager::PerCpuTable::IsProtected() {
+  return *GetStateForThread() != 0;
+}
+
+/**
+ * Sum the exits of every CPU first and the entries second: a reader that had
+ * left by the time its exit was counted must have entered before, so it is
+ * counted on both sides and the sums only match if nobody is left inside.
+ */
+bool EpochManager::PerCpuTable::IsDrained(uint32_t index) {
+  uint64_t unlocks = 0;
+  for (uint32_t i = 0; i < cpu_count_; ++i) {
+    unlocks += counters_[i].unlock[index].load(std::memory_order_acquire);
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  uint64_t locks = 0;
+  for (uint32_t i = 0; i < cpu_count_; ++i) {
+    locks += counters_[i].lock[index].load(std::memory_order_acquire);
+  }
+  // Order the check before whatever reclamation it allows.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  return locks == unlocks;
+}
@@ -1,7 +1,15 @@
 #pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <x86intrin.h>
+#include <algorithm>
 #include <cassert>
+#include <functional>
+#include <string>
+#include <thread>
 #include "epoch_manager.h"
+#include "utils.h"
 #ifdef PMEM
 #include <libpmemobj.h>
 POBJ_LAYOUT_BEGIN(garbagelist);
@@ -33,6 +41,119 @@ class IGarbageList {
                     void* context) = 0;
 };
 
+/// Storage policies of BasicGarbageList: where its ring lives and how slots
+/// are written. A policy provides
+///  - kPersistent: whether slots are written with streaming stores and
+///    fenced, so that Recovery() finds them after a crash;
+///  - Allocate(size, &mem, &fresh): \a size bytes, 64 byte aligned; fresh
+///    is set to false if they still hold the ring of a previous run, which
+///    the list then leaves as is;
+///  - Free(mem, size);
+///  - ForShard(i): the storage for shard \a i of a BasicShardedGarbageList.
+/// The list picks its code paths from the policy at compile time, so lists
+/// of different policies can live side by side in one binary.
+
+/// Volatile ring in DRAM, written with plain stores.
+struct DramStorage {
+  static const constexpr bool kPersistent = false;
+
+  bool Allocate(size_t size, void** mem, bool* fresh) {
+    if (posix_memalign(mem, 64, size)) return false;
+    *fresh = true;
+    return true;
+  }
+
+  void Free(void* mem, size_t /*size*/) { free(mem); }
+
+  DramStorage ForShard(uint32_t /*shard*/) const { return *this; }
+};
+
+#ifdef PMEM
+/// Ring allocated from a PMDK pool. The list itself is expected to live in
+/// the pool too (e.g. as part of its root object), so that Recovery() finds
+/// the ring through it after a restart.
+struct PmdkStorage {
+  static const constexpr bool kPersistent = true;
+
+  PmdkStorage(PMEMobjpool* pool = nullptr) : pool{pool} {}
+
+  bool Allocate(size_t size, void** mem, bool* fresh) {
+    if (!pool) return false;
+    // TODO(hao): better error handling
+    PMEMoid ptr;
+    *mem = nullptr;
+    TX_BEGIN(pool) {
+      // Every PMDK allocation so far will pad to 64 cacheline boundry.
+      // To prevent memory leak, pmdk will chain the allocations by adding a
+      // 16-byte pointer at the beginning of the requested memory, which breaks
+      // the memory alignment. the PMDK_PADDING is to force pad again
+      pmemobj_zalloc(pool, &ptr, size + very_pm::kPMDK_PADDING,
+                     TOID_TYPE_NUM(char));
+      *mem = (char*)pmemobj_direct(ptr) + very_pm::kPMDK_PADDING;
+    }
+    TX_END
+    *fresh = true;
+    return *mem != nullptr;
+  }
+
+  void Free(void* mem, size_t /*size*/) {
+    auto oid = pmemobj_oid((char*)mem - very_pm::kPMDK_PADDING);
+    pmemobj_free(&oid);
+  }
+
+  PmdkStorage ForShard(uint32_t /*shard*/) const { return *this; }
+
+  PMEMobjpool* pool;
+};
+#endif
+
+/// Ring in a file mapped straight into the address space, e.g. on a DAX
+/// file system, without PMDK. The list object may live in DRAM: initializing
+/// a list over a file that already holds a ring of the same size maps it
+/// as is, and Recovery() or LazyRecovery() then reclaims the leftovers.
+/// Slots are only durable once fenced if the mapping is synchronous
+/// (MAP_SYNC), which needs DAX; other files work, but only for testing.
+struct MmapStorage {
+  static const constexpr bool kPersistent = true;
+
+  MmapStorage() {}
+  explicit MmapStorage(const std::string& path) : path{path} {}
+
+  bool Allocate(size_t size, void** mem, bool* fresh) {
+    if (path.empty()) return false;
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, very_pm::CREATE_MODE_RW);
+    if (fd < 0) return false;
+    struct stat st;
+    *fresh = fstat(fd, &st) || static_cast<size_t>(st.st_size) != size;
+    // Truncating to 0 first zeroes a ring of another size.
+    if (*fresh && (ftruncate(fd, 0) || ftruncate(fd, size))) {
+      close(fd);
+      return false;
+    }
+    void* addr = MAP_FAILED;
+#ifdef MAP_SYNC
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_SHARED_VALIDATE | MAP_SYNC, fd, 0);
+#endif
+    if (addr == MAP_FAILED) {
+      addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED) return false;
+    *mem = addr;
+    return true;
+  }
+
+  void Free(void* mem, size_t size) { munmap(mem, size); }
+
+  /// Every shard maps its own file, \a path suffixed with the shard number.
+  MmapStorage ForShard(uint32_t shard) const {
+    return MmapStorage{path + "." + std::to_string(shard)};
+  }
+
+  std::string path;
+};
+
 /// Tracks items that have been removed from a data structure but to which
 /// there may still be concurrent accesses using the item from other threads.
 /// GarbageList works together with the EpochManager to ensure that items
@@ -46,7 +167,13 @@ class IGarbageList {
 /// ready for reuse, freeing them up if it is safe to do so. The user of the
 /// GarbageList provides a callback that is invoked so custom logic can be used
 /// to reclaim resources.
-class GarbageList : public IGarbageList {
+///
+/// \tparam Storage
+///      Where the ring lives and how its slots are written, see DramStorage,
+///      PmdkStorage and MmapStorage. GarbageList is the policy the build
+///      targets, PmdkStorage with PMEM and DramStorage otherwise.
+template <typename Storage>
+class BasicGarbageList : public IGarbageList {
  public:
   /// Holds a pointer to an object in the garbage list along with the Epoch
   /// in which it was removed and a chain field so that it can be linked into
@@ -91,26 +218,133 @@ class GarbageList : public IGarbageList {
                   void* context) {
       assert(this->removal_epoch == invalid_epoch);
 
-#ifdef PMEM
-      auto value = _mm256_set_epi64x((int64_t)removed_item, (int64_t)context,
-                                     (int64_t)callback, (int64_t)epoch);
-      _mm256_stream_si256((__m256i*)(this), value);
-#else
-      this->destroy_callback = callback;
-      this->destroy_callback_context = context;
-      this->removed_item = removed_item;
-      this->removal_epoch = epoch;
-#endif
+      if constexpr (Storage::kPersistent) {
+        auto value = _mm256_set_epi64x((int64_t)removed_item,
+                                       (int64_t)context, (int64_t)callback,
+                                       (int64_t)epoch);
+        _mm256_stream_si256((__m256i*)(this), value);
+      } else {
+        this->destroy_callback = callback;
+        this->destroy_callback_context = context;
+        this->removed_item = removed_item;
+        this->removal_epoch = epoch;
+      }
     }
   };
   static_assert(std::is_pod<Item>::value, "Item should be POD");
   static const constexpr uint64_t invalid_epoch = ~0llu;
 
+  /// What Push() does once a whole lap of the ring found no slot whose item
+  /// is safe to reclaim, i.e. when a stalled reader pins every item.
+  enum class OverflowPolicy {
+    /// Keep probing the ring until a slot frees up. Burns a CPU for as long
+    /// as the reader stalls.
+    kSpin,
+    /// Park the item on an overflow list in DRAM, which Scavenge() and later
+    /// pushes drain once the epoch moves on. Push() never waits.
+    kOverflow,
+    /// Sleep until the safe epoch advances, then probe the ring again. Must
+    /// not be used by threads that push from inside the protected region
+    /// while being the only thing holding the epoch back.
+    kBlock,
+    /// Give up and return false; the caller keeps ownership of the item.
+    kFail,
+  };
+
+  /// How often each overflow path of Push() fired.
+  struct OverflowStats {
+    /// Push() calls that probed a whole lap of the ring without success.
+    uint64_t full_laps;
+
+    /// Items parked on the overflow list (kOverflow).
+    uint64_t overflowed;
+
+    /// Items currently on the overflow list.
+    uint64_t overflow_depth;
+
+    /// Times Push() slept waiting for the safe epoch to advance (kBlock).
+    uint64_t blocked;
+
+    /// Push() calls that returned false (kFail).
+    uint64_t failed;
+
+    /// PushWithSize() calls held back by the byte cap, see
+    /// SetByteThresholds().
+    uint64_t throttled;
+  };
+
+  /// Slots a push probes before going straight to a non-empty overflow list;
+  /// keeps pushes cheap for as long as the reader stalls.
+  static const uint64_t kOverflowProbes = 64;
+
+  /// Destroys \a count objects pushed with the same callback and context at
+  /// once, see RegisterBulkCallback().
+  typedef void (*BulkDestroyCallback)(void* callback_context, void** objects,
+                                      size_t count);
+
+  /// Expired items Scavenge() and the reclaimer collect before destroying
+  /// them as a batch.
+  static const uint32_t kDestroyBatch = 64;
+
+  /// Items ahead of the one being destroyed whose object is prefetched.
+  static const uint32_t kPrefetchDistance = 4;
+
+  /// Slots a Scavenge() call sweeps for leftovers after a LazyRecovery().
+  static const uint64_t kRecoveryStep = 1024;
+
+  /// Upper bound on the number of bulk callbacks, see RegisterBulkCallback().
+  static const uint32_t kMaxBulkCallbacks = 8;
+
+  /// Upper bound on the number of recyclers, see RegisterRecycler().
+  static const uint32_t kMaxRecyclers = 8;
+
+  /// How often recycling kicked in, see RegisterRecycler().
+  struct RecycleStats {
+    /// Expired items parked in a recycle cache instead of destroyed.
+    uint64_t recycled;
+
+    /// Recycle() calls served from the cache.
+    uint64_t reused;
+  };
+
   /// Construct a GarbageList in an uninitialized state.
-  GarbageList() : epoch_manager_{}, tail_{}, item_count_{}, items_{} {}
+  BasicGarbageList()
+      : epoch_manager_{},
+        tail_{},
+        item_count_{},
+        items_{},
+        reclaimer_{nullptr},
+        reclaimer_running_{false},
+        reclaim_batch_{0},
+        reclaim_cursor_{0},
+        reclaimed_{0},
+        overflow_policy_{OverflowPolicy::kSpin},
+        overflow_depth_{0},
+        full_laps_{0},
+        overflowed_{0},
+        blocked_{0},
+        failed_{0},
+        item_bytes_{nullptr},
+        retired_bytes_{0},
+        bytes_since_advance_{0},
+        advance_bytes_{0},
+        max_bytes_{0},
+        throttled_{0},
+        recyclers_{},
+        recycler_count_{0},
+        recycle_id_{0},
+        recycled_{0},
+        reused_{0},
+        bulk_callbacks_{},
+        bulk_callback_count_{0},
+        slot_states_{nullptr},
+        recovering_{false},
+        recovery_cursor_{0},
+        recovery_remaining_{0},
+        recovered_{0} {}
 
   /// Uninitialize the GarbageList (if still initialized) and destroy it.
-  virtual ~GarbageList() { Uninitialize(); }
+  virtual ~BasicGarbageList() { Uninitialize(); }
 
   /// Initialize the GarbageList and associate it with an EpochManager.
   /// This must be called on a newly constructed instance before it
@@ -120,10 +354,16 @@ class GarbageList : public IGarbageList {
   /// \param pEpochManager
   ///      EpochManager that is used to determine when it is safe to reclaim
   ///      items pushed onto the list. Must not be nullptr.
+  /// \param storage
+  ///      Where to allocate the ring, e.g. the PMDK pool. If it still holds
+  ///      the ring of a previous run, follow up with Recovery() or
+  ///      LazyRecovery().
   /// \param nItems
   ///      Number of addresses that can be held aside for pointer stability.
-  ///      If this number is too small the system runs the risk of deadlock.
+  ///      If this number is too small pushes run into \a overflow_policy.
   ///      Must be a power of two.
+  /// \param overflow_policy
+  ///      What Push() does when no slot can be reclaimed, see OverflowPolicy.
   ///
   /// \retval S_OK
   ///      The instance is now initialized and ready for use.
@@ -131,14 +371,9 @@ class GarbageList : public IGarbageList {
   ///      The instance was already initialized; no effect.
   /// \retval E_INVALIDARG
   ///      \a nItems wasn't a power of two.
-
-#ifdef PMEM
-  virtual bool Initialize(EpochManager* epoch_manager, PMEMobjpool* pool_,
-                          size_t item_count = 128 * 1024) {
-#else
-  virtual bool Initialize(EpochManager* epoch_manager,
-                          size_t item_count = 128 * 1024) {
-#endif
+  bool Initialize(EpochManager* epoch_manager, const Storage& storage,
+                  size_t item_count = 128 * 1024,
+                  OverflowPolicy overflow_policy = OverflowPolicy::kSpin) {
     if (epoch_manager_) return true;
 
     if (!epoch_manager) return false;
@@ -149,35 +384,32 @@ class GarbageList : public IGarbageList {
 
     size_t nItemArraySize = sizeof(*items_) * item_count;
 
-#ifdef PMEM
-    // TODO(hao): better error handling
-    PMEMoid ptr;
-    TX_BEGIN(pool_) {
-      // Every PMDK allocation so far will pad to 64 cacheline boundry.
-      // To prevent memory leak, pmdk will chain the allocations by adding a
-      // 16-byte pointer at the beginning of the requested memory, which breaks
-      // the memory alignment. the PMDK_PADDING is to force pad again
-      pmemobj_zalloc(pool_, &ptr, nItemArraySize + very_pm::kPMDK_PADDING,
-                     TOID_TYPE_NUM(char));
-      items_ = (GarbageList::Item*)((char*)pmemobj_direct(ptr) +
-                                    very_pm::kPMDK_PADDING);
-    }
-    TX_END
-#else
-    posix_memalign((void**)&items_, 64, nItemArraySize);
-#endif
+    storage_ = storage;
+    bool fresh = true;
+    void* mem = nullptr;
+    if (!storage_.Allocate(nItemArraySize, &mem, &fresh)) return false;
+    items_ = reinterpret_cast<Item*>(mem);
 
-    if (!items_) return false;
-
-    for (size_t i = 0; i < item_count; ++i) new (&items_[i]) Item{};
+    if (fresh) {
+      for (size_t i = 0; i < item_count; ++i) new (&items_[i]) Item{};
+    }
 
     item_count_ = item_count;
     tail_ = 0;
+    reclaim_cursor_ = -1;
+    overflow_policy_ = overflow_policy;
     epoch_manager_ = epoch_manager;
 
     return true;
   }
 
+  /// Initialize() with a default constructed \a Storage, e.g. in DRAM.
+  virtual bool Initialize(
+      EpochManager* epoch_manager, size_t item_count = 128 * 1024,
+      OverflowPolicy overflow_policy = OverflowPolicy::kSpin) {
+    return Initialize(epoch_manager, Storage{}, item_count, overflow_policy);
+  }
+
   /// Uninitialize the GarbageList and disassociate from its EpochManager;
   /// for each item still on the list call its destructor and free it.
   /// Careful: objects freed by this call will NOT obey the epoch protocol,
@@ -192,6 +424,8 @@ class GarbageList : public IGarbageList {
   virtual bool Uninitialize() {
     if (!epoch_manager_) return true;
 
+    StopReclaimer();
+
     for (size_t i = 0; i < item_count_; ++i) {
       Item& item = items_[i];
       if (item.removed_item) {
@@ -200,13 +434,25 @@ class GarbageList : public IGarbageList {
         item.removal_epoch = 0;
       }
     }
+    for (auto& overflow : overflow_) {
+      overflow.item.destroy_callback(overflow.item.destroy_callback_context,
+                                     overflow.item.removed_item);
+    }
+    overflow_.clear();
+    overflow_depth_ = 0;
+    ReleaseRecycleCaches();
+    bulk_callback_count_ = 0;
+    recovering_ = false;
+    free(slot_states_);
+    slot_states_ = nullptr;
+    free(item_bytes_);
+    item_bytes_ = nullptr;
+    retired_bytes_ = 0;
+    bytes_since_advance_ = 0;
+    advance_bytes_ = 0;
+    max_bytes_ = 0;
 
-#ifdef PMEM
-    auto oid = pmemobj_oid((char*)items_ - very_pm::kPMDK_PADDING);
-    pmemobj_free(&oid);
-#else
-    delete items_;
-#endif
+    storage_.Free(items_, sizeof(*items_) * item_count_);
 
     items_ = nullptr;
     tail_ = 0;
@@ -239,101 +485,170 @@ class GarbageList : public IGarbageList {
   ///      \a destroyCallback; it threads state to destroyCallback calls so
   ///      they can access, for example, the allocator from which the object
   ///      was allocated. Left uninterpreted, so may be nullptr.
+  ///
+  /// \retval false
+  ///      Only with OverflowPolicy::kFail: no slot could be reclaimed and the
+  ///      item was not pushed.
   virtual bool Push(void* removed_item, DestroyCallback callback,
                     void* context) {
+    return PushSized(removed_item, callback, context, 0);
+  }
+
+  /// Like Push(), but account \a bytes of memory to the item: the list
+  /// advances the epoch and scavenges every \a advance_bytes retired, and
+  /// holds pushes back above the cap, see SetByteThresholds().
+  bool PushWithSize(void* removed_item, uint64_t bytes,
+                    DestroyCallback callback, void* context) {
+    if (max_bytes_ &&
+        retired_bytes_.load(std::memory_order_relaxed) + bytes > max_bytes_) {
+      ThrottleBytes(bytes);
+    }
+    if (!PushSized(removed_item, callback, context, bytes)) return false;
+
+    if (advance_bytes_) {
+      uint64_t before =
+          bytes_since_advance_.fetch_add(bytes, std::memory_order_relaxed);
+      if ((before + bytes) / advance_bytes_ != before / advance_bytes_) {
+        epoch_manager_->RequestEpochAdvance();
+        Scavenge();
+      }
+    }
+    return true;
+  }
+
+  /// Make the list track the bytes its items hold, as passed to
+  /// PushWithSize(); Push() counts as 0 bytes. Call after Initialize() and
+  /// before pushing concurrently.
+  ///
+  /// \param advance_bytes
+  ///      Roll the epoch over and scavenge every time this many bytes were
+  ///      retired, on top of the roll over every quarter of the ring. 0
+  ///      disables it.
+  /// \param max_bytes
+  ///      Cap on unreclaimed bytes. PushWithSize() above the cap scavenges
+  ///      and, unless the calling thread is protected (it might be the one
+  ///      holding the epoch back), sleeps until the epoch advances far
+  ///      enough. An item larger than the cap goes through once everything
+  ///      else has been reclaimed. 0 disables it.
+  bool SetByteThresholds(uint64_t advance_bytes, uint64_t max_bytes) {
+    if (!epoch_manager_) return false;
+    if (!item_bytes_) {
+      item_bytes_ =
+          reinterpret_cast<uint64_t*>(calloc(item_count_, sizeof(uint64_t)));
+      if (!item_bytes_) return false;
+    }
+    advance_bytes_ = advance_bytes;
+    max_bytes_ = max_bytes;
+    return true;
+  }
+
+  /// Bytes held by items on the list that have not been reclaimed yet.
+  uint64_t GetRetiredBytes() {
+    return retired_bytes_.load(std::memory_order_relaxed);
+  }
+
+  /// Like Push(), but give up after probing \a max_attempts slots without
+  /// finding one whose item is safe to reclaim. Returns false in that case,
+  /// leaving the caller free to try elsewhere (see ShardedGarbageList).
+  /// \a bytes is accounted as in PushWithSize(), without the thresholds.
+  bool TryPush(void* removed_item, DestroyCallback callback, void* context,
+               uint64_t max_attempts, uint64_t bytes = 0) {
     Epoch removal_epoch = epoch_manager_->GetCurrentEpoch();
 
-    for (;;) {
+    for (uint64_t attempt = 0; attempt < max_attempts; ++attempt) {
       int64_t slot = (tail_.fetch_add(1) - 1) & (item_count_ - 1);
 
       // Everytime we work through 25% of the capacity of the list roll
       // the epoch over.
       if (((slot << 2) & (item_count_ - 1)) == 0)
-        epoch_manager_->BumpCurrentEpoch();
+        epoch_manager_->RequestEpochAdvance();
 
-      Item& item = items_[slot];
+      // With the reclaimer running only take empty slots, unless a whole
+      // lap found none: then the reclaimer is lagging and we help out.
+      bool reclaim = !reclaimer_running_.load(std::memory_order_relaxed) ||
+                     attempt >= item_count_;
+      if (!ClaimSlot(slot, reclaim)) continue;
+      WriteSlot(slot, removed_item, callback, context, removal_epoch, bytes);
+      return true;
+    }
+    return false;
+  }
 
-      Epoch priorItemEpoch = item.removal_epoch;
-      if (priorItemEpoch == invalid_epoch) {
-        // Someone is modifying this slot. Try elsewhere.
-        continue;
-      }
+  /// One element of a PushBatch() call.
+  struct BatchItem {
+    void* removed_item;
+    DestroyCallback destroy_callback;
+    void* context;
+  };
 
-      Epoch result = CompareExchange64<Epoch>(&item.removal_epoch,
-                                              invalid_epoch, priorItemEpoch);
-      if (result != priorItemEpoch) {
-        // Someone else is now modifying the slot or it has been
-        // replaced with a new item. If someone replaces the old item
-        // with a new one of the same epoch number, that's ok.
-        continue;
+  /// Push \a count items at once: one epoch read for all of them and one
+  /// tail_ increment per quarter of the ring, instead of one each. Slots of
+  /// the claimed range whose old item cannot be reclaimed yet are skipped,
+  /// and the items left over go through Push(). With persistent storage the
+  /// items are written with back-to-back streaming stores and a single fence.
+  ///
+  /// Returns false if Push() failed on a leftover item (only with
+  /// OverflowPolicy::kFail); the batch is then retired up to, but excluding,
+  /// item \a *pushed.
+  bool PushBatch(const BatchItem* batch, size_t count,
+                 size_t* pushed = nullptr) {
+    size_t done = 0;
+    if (pushed) *pushed = 0;
+    Epoch removal_epoch = epoch_manager_->GetCurrentEpoch();
+    uint64_t quarter = std::max<uint64_t>(item_count_ >> 2, 1);
+
+    while (count) {
+      uint64_t chunk = std::min<uint64_t>(count, quarter);
+      int64_t first = tail_.fetch_add(chunk) - 1;
+
+      // Same epoch roll over as Push(): once per quarter of the ring.
+      uint64_t offset = first & (quarter - 1);
+      if (offset == 0 || offset + chunk > quarter) {
+        epoch_manager_->RequestEpochAdvance();
       }
 
-      // Ensure it is safe to free the old entry.
-      if (priorItemEpoch) {
-        if (!epoch_manager_->IsSafeToReclaim(priorItemEpoch)) {
-          // Uh-oh, we couldn't free the old entry. Things aren't looking
-          // good, but maybe it was just the result of a race. Replace the
-          // epoch number we mangled and try elsewhere.
-          *((volatile Epoch*)&item.removal_epoch) = priorItemEpoch;
+      uint64_t written = 0;
+      for (uint64_t i = 0; i < chunk; ++i) {
+        int64_t slot = (first + i) & (item_count_ - 1);
+        if (!ClaimSlot(slot, !reclaimer_running_.load(
+                                 std::memory_order_relaxed))) {
           continue;
         }
-        item.destroy_callback(item.destroy_callback_context, item.removed_item);
+        const BatchItem& item = batch[written++];
+        WriteSlot(slot, item.removed_item, item.destroy_callback, item.context,
+                  removal_epoch);
       }
-
-      Item stack_item;
-      stack_item.destroy_callback = callback;
-      stack_item.destroy_callback_context = context;
-      stack_item.removed_item = removed_item;
-      *((volatile Epoch*)&stack_item.removal_epoch) = removal_epoch;
-
-#ifdef PMEM
-      auto value = _mm256_set_epi64x((int64_t)removed_item, (int64_t)context,
-                                     (int64_t)callback, (int64_t)removal_epoch);
-      _mm256_stream_si256((__m256i*)(items_ + slot), value);
-#else
-      items_[slot] = stack_item;
-#endif
-      return true;
+      if constexpr (Storage::kPersistent) _mm_sfence();
+      done += written;
+      for (uint64_t i = written; i < chunk; ++i) {
+        if (!Push(batch[i].removed_item, batch[i].destroy_callback,
+                  batch[i].context)) {
+          if (pushed) *pushed = done;
+          return false;
+        }
+        done += 1;
+      }
+      batch += chunk;
+      count -= chunk;
     }
+    if (pushed) *pushed = done;
+    return true;
   }
 
   /// Used to reserve a place for (persistent memory) allocators that requires a
   /// pre-existing memory location. The corresponding removal_epoch will be
   /// marked as invalid epoch.
   Item* ReserveItem() {
-    Epoch removal_epoch = epoch_manager_->GetCurrentEpoch();
     for (;;) {
       int64_t slot = (tail_.fetch_add(1) - 1) & (item_count_ - 1);
 
       // Everytime we work through 25% of the capacity of the list roll
       // the epoch over.
       if (((slot << 2) & (item_count_ - 1)) == 0)
-        epoch_manager_->BumpCurrentEpoch();
-
-      Item& item = items_[slot];
-      Epoch priorItemEpoch = item.removal_epoch;
+        epoch_manager_->RequestEpochAdvance();
 
-      Epoch result = CompareExchange64<Epoch>(&item.removal_epoch,
-                                              invalid_epoch, priorItemEpoch);
-      if (result != priorItemEpoch) {
-        // Someone else is now modifying the slot or it has been
-        // replaced with a new item. If someone replaces the old item
-        // with a new one of the same epoch number, that's ok.
-        continue;
-      }
-
-      // Ensure it is safe to free the old entry.
-      if (priorItemEpoch) {
-        if (!epoch_manager_->IsSafeToReclaim(priorItemEpoch)) {
-          // Uh-oh, we couldn't free the old entry. Things aren't looking
-          // good, but maybe it was just the result of a race. Replace the
-          // epoch number we mangled and try elsewhere.
-          *((volatile Epoch*)&item.removal_epoch) = priorItemEpoch;
-          continue;
-        }
-        item.destroy_callback(item.destroy_callback_context, item.removed_item);
-      }
-      return &item;
+      // The slot stays locked, i.e. at #invalid_epoch, until ResetItem().
+      if (ClaimSlot(slot)) return &items_[slot];
     }
   }
 
@@ -342,97 +657,866 @@ class GarbageList : public IGarbageList {
   bool ResetItem(Item* item) {
     auto old_epoch = item->removal_epoch;
     assert(old_epoch == invalid_epoch);
+    if (recovering_.load(std::memory_order_acquire)) {
+      MarkSlotWritten(item - items_);
+    }
     item->removal_epoch = 0;
     item->removed_item = nullptr;
     return true;
   }
 
-#ifdef PMEM
+  /// Whether \a item is a slot of this list's ring, e.g. one handed out by
+  /// ReserveItem().
+  bool OwnsItem(const Item* item) {
+    std::less<const Item*> less;
+    return items_ && !less(item, items_) && less(item, items_ + item_count_);
+  }
+
+  /// What a Recovery() pass did.
+  struct RecoveryStats {
+    /// Items whose destroy callback was called.
+    uint64_t reclaimed;
+
+    /// Wall clock time of the pass.
+    uint64_t elapsed_us;
+
+    /// Threads the ring was split across.
+    uint32_t threads;
+  };
+
   /// Recover the grabage list from a user specified location
   /// Scan all the items in the larbage list, if any item that is not nullptr,
-  /// we call the destroy callback.
-  bool Recovery(EpochManager* epoch_manager, PMEMobjpool* pmdk_pool) {
-    uint32_t reclaimed{0};
-    for (size_t i = 0; i < item_count_; ++i) {
-      Item& item = items_[i];
-      if (item.removed_item != nullptr) {
-        item.destroy_callback(item.destroy_callback_context, item.removed_item);
-        new (&items_[i]) Item{};
-        reclaimed += 1;
-      }
-    }
+  /// we call the destroy callback. Only for persistent \a Storage; \a storage
+  /// is the one the ring was allocated from. The ring must be mapped already:
+  /// a list whose object lives in DRAM, e.g. over MmapStorage, is first
+  /// Initialize()d over the same storage, which keeps the old ring.
+  ///
+  /// \param thread_count
+  ///      Split the ring into this many ranges, scanned in parallel; the
+  ///      destroy callbacks must then be thread safe. Capped at one range per
+  ///      1024 slots.
+  /// \param stats
+  ///      If not nullptr, set to what the pass did.
+  bool Recovery(EpochManager* epoch_manager, const Storage& storage,
+                uint32_t thread_count = 1, RecoveryStats* stats = nullptr) {
+    static_assert(Storage::kPersistent, "Nothing to recover in DRAM");
+    if (!items_) return false;
+    recovering_ = false;
+    RecoveryStats result = RecoverItems(thread_count);
 #ifdef TEST_BUILD
-    LOG(INFO) << "[Garbage List]: reclaimed " << reclaimed << " items."
-              << std::endl;
+    LOG(INFO) << "[Garbage List]: reclaimed " << result.reclaimed
+              << " items in " << result.elapsed_us << "us on "
+              << result.threads << " threads." << std::endl;
 #endif
+    if (stats) *stats = result;
     tail_ = 0;
+    reclaim_cursor_ = -1;
     epoch_manager_ = epoch_manager;
-    pmdk_pool_ = pmdk_pool;
+    storage_ = storage;
     return true;
   }
-#endif
+
+  /// Bring the list back online without destroying the items left over from
+  /// before the crash first. Leftovers are treated as reclaimable right away
+  /// (their epochs belong to the previous run): pushes reclaim them as they
+  /// reach their slots, and Scavenge(), the reclaimer thread or explicit
+  /// RecoverStep() calls sweep the rest of the ring in the background, so
+  /// restart time no longer depends on the ring size. The ring must be
+  /// mapped already, see Recovery().
+  bool LazyRecovery(EpochManager* epoch_manager, const Storage& storage) {
+    static_assert(Storage::kPersistent, "Nothing to recover in DRAM");
+    if (!items_ || !BeginLazyRecovery()) return false;
+    tail_ = 0;
+    reclaim_cursor_ = -1;
+    epoch_manager_ = epoch_manager;
+    storage_ = storage;
+    return true;
+  }
+
+  /// Sweep up to \a max_slots slots for items left over from before a
+  /// LazyRecovery(). Returns the number of items destroyed; 0 once the whole
+  /// ring has been swept.
+  uint64_t RecoverStep(uint64_t max_slots) {
+    if (!recovering_.load(std::memory_order_acquire)) return 0;
+    uint64_t begin =
+        recovery_cursor_.fetch_add(max_slots, std::memory_order_relaxed);
+    if (begin >= item_count_) return 0;
+    uint64_t end = std::min<uint64_t>(begin + max_slots, item_count_);
+
+    Item batch[kDestroyBatch];
+    uint32_t batched = 0;
+    uint64_t recovered = 0;
+    for (uint64_t slot = begin; slot < end; ++slot) {
+      for (;;) {
+        // Written or held by this run: nothing left over in the slot.
+        if (SlotState(slot)) break;
+        Item& item = items_[slot];
+        if (item.removal_epoch != invalid_epoch && !item.removed_item) break;
+        if (!ClaimSlot(slot, true, &batch[batched])) continue;
+        WriteSlot(slot, nullptr, nullptr, nullptr, 0);
+        if (batch[batched].removed_item) {
+          recovered += 1;
+          if (++batched == kDestroyBatch) {
+            DestroyBatch(batch, batched);
+            batched = 0;
+          }
+        }
+        break;
+      }
+    }
+    DestroyBatch(batch, batched);
+
+    // ClaimSlot() counted the items in #recovered_ already.
+    if (recovery_remaining_.fetch_sub(end - begin,
+                                      std::memory_order_acq_rel) ==
+        end - begin) {
+      recovering_.store(false, std::memory_order_release);
+    }
+    return recovered;
+  }
+
+  /// Whether items left over from before a LazyRecovery() may remain.
+  bool IsRecovering() { return recovering_.load(std::memory_order_acquire); }
+
+  /// Leftover items destroyed since LazyRecovery(), by pushes or sweeps.
+  uint64_t GetRecoveredCount() {
+    return recovered_.load(std::memory_order_relaxed);
+  }
 
   /// Scavenge items that are safe to be reused - useful when the user cannot
   /// wait until the garbage list is full. Currently (May 2016) the only user is
   /// MwCAS' descriptor pool which we'd like to keep small. Tedious to tune the
   /// descriptor pool size vs. garbage list size, so there is this function.
+  ///
+  /// Only walks the slots pushed since the last scavenge, up to the first
+  /// item that is not safe yet (see ReclaimExpired()), so it is cheap enough
+  /// to call on every epoch advance. Returns the number of items destroyed.
   int32_t Scavenge() {
-    auto max_slot = tail_.load(std::memory_order_relaxed);
-    int32_t scavenged = 0;
+    uint64_t advanced = 0;
+    uint64_t reclaimed = ReclaimExpired(item_count_, &advanced);
+    if (overflow_depth_.load(std::memory_order_relaxed)) {
+      reclaimed += DrainOverflow();
+    }
+    if (recovering_.load(std::memory_order_relaxed)) {
+      reclaimed += RecoverStep(kRecoveryStep);
+    }
+    return reclaimed;
+  }
+
+  /// Returns (a pointer to) the epoch manager associated with this garbage
+  /// list.
+  EpochManager* GetEpoch() { return epoch_manager_; }
+
+  /// Start a background thread that owns item destruction: Push() then only
+  /// fills empty slots, and the reclaimer walks the ring behind the pushers,
+  /// destroying expired items in the order they were pushed (and so in epoch
+  /// order). Pushers only fall back to destroying items themselves when a
+  /// whole lap of the ring found no empty slot.
+  ///
+  /// \param batch_size
+  ///      Slots the reclaimer visits before checking whether to stop.
+  /// \param cpu
+  ///      CPU to pin the reclaimer to (Linux only); -1 leaves it unpinned.
+  bool StartReclaimer(uint64_t batch_size = 64, int cpu = -1) {
+    if (!epoch_manager_ || !batch_size) return false;
+    std::unique_lock<std::mutex> lock(reclaimer_mutex_);
+    if (reclaimer_) return true;
+
+    reclaim_batch_ = batch_size;
+    reclaim_cursor_ = tail_.load(std::memory_order_acquire) - 1;
+    reclaimer_running_ = true;
+    reclaimer_ = new std::thread([this]() {
+      // Nobody would ever take objects off the reclaimer's own cache.
+      tls_no_recycle_ = true;
+      std::unique_lock<std::mutex> lock(reclaimer_mutex_);
+      while (reclaimer_running_.load(std::memory_order_relaxed)) {
+        lock.unlock();
+        uint64_t advanced = 0;
+        uint64_t reclaimed = ReclaimExpired(reclaim_batch_, &advanced);
+        if (overflow_depth_.load(std::memory_order_relaxed)) {
+          reclaimed += DrainOverflow();
+        }
+        if (recovering_.load(std::memory_order_relaxed)) {
+          reclaimed += RecoverStep(reclaim_batch_);
+          advanced += 1;
+        }
+        reclaimed_.fetch_add(reclaimed, std::memory_order_relaxed);
+        lock.lock();
+        if (!advanced && !reclaimed) {
+          reclaimer_cv_.wait_for(lock, std::chrono::microseconds(100), [this]() {
+            return !reclaimer_running_.load(std::memory_order_relaxed);
+          });
+        }
+      }
+    });
+#ifdef __linux__
+    if (cpu >= 0) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(cpu, &cpus);
+      pthread_setaffinity_np(reclaimer_->native_handle(), sizeof(cpus), &cpus);
+    }
+#endif
+    return true;
+  }
+
+  /// Stop and join the reclaimer thread, if any. Items it had not reached
+  /// yet are reclaimed by Push() and Scavenge() again.
+  void StopReclaimer() {
+    std::thread* reclaimer = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(reclaimer_mutex_);
+      reclaimer = reclaimer_;
+      reclaimer_ = nullptr;
+      reclaimer_running_ = false;
+    }
+    if (!reclaimer) return;
+    reclaimer_cv_.notify_all();
+    reclaimer->join();
+    delete reclaimer;
+  }
+
+  /// Progress of the reclaimer thread.
+  struct ReclaimerStats {
+    /// Slots pushed to that the reclaimer has not visited yet.
+    uint64_t queue_depth;
+
+    /// Items destroyed by the reclaimer so far.
+    uint64_t reclaimed;
+  };
+
+  ReclaimerStats GetReclaimerStats() {
+    int64_t depth = tail_.load(std::memory_order_relaxed) - 1 -
+                    reclaim_cursor_.load(std::memory_order_relaxed);
+    depth = std::min<int64_t>(std::max<int64_t>(depth, 0), item_count_);
+    return ReclaimerStats{static_cast<uint64_t>(depth),
+                          reclaimed_.load(std::memory_order_relaxed)};
+  }
+
+  OverflowPolicy GetOverflowPolicy() { return overflow_policy_; }
+
+  OverflowStats GetOverflowStats() {
+    return OverflowStats{full_laps_.load(std::memory_order_relaxed),
+                         overflowed_.load(std::memory_order_relaxed),
+                         overflow_depth_.load(std::memory_order_relaxed),
+                         blocked_.load(std::memory_order_relaxed),
+                         failed_.load(std::memory_order_relaxed),
+                         throttled_.load(std::memory_order_relaxed)};
+  }
+
+  /// Number of slots in the ring.
+  size_t GetItemCount() { return item_count_; }
+
+  /// Recycle expired items pushed with \a callback and \a context instead of
+  /// destroying them: the thread that finds them expired keeps up to
+  /// \a max_cached of them in its recycle cache, and hands them out again
+  /// through Recycle(). Only for callbacks that do nothing but free the
+  /// memory, which is handed out again as is. Call after Initialize() and
+  /// before pushing concurrently.
+  ///
+  /// With persistent storage the cache lives in DRAM: cached objects are
+  /// leaked on a crash, like objects allocated but not linked yet.
+  ///
+  /// \param recycler
+  ///      Set to the id to pass to Recycle().
+  bool RegisterRecycler(DestroyCallback callback, void* context,
+                        uint32_t max_cached, uint32_t* recycler) {
+    if (!epoch_manager_ || !callback || !max_cached) return false;
+    if (recycler_count_ == kMaxRecyclers) return false;
+    if (!recycle_id_) {
+      recycle_id_ = ThreadSlots::AcquireOwner();
+    }
+    recyclers_[recycler_count_] = Recycler{callback, context, max_cached};
+    *recycler = recycler_count_++;
+    return true;
+  }
+
+  /// Take an object off the calling thread's cache of \a recycler, or
+  /// nullptr if it is empty and the caller has to allocate.
+  void* Recycle(uint32_t recycler) {
+    if (recycler >= recycler_count_) return nullptr;
+    auto& objects = GetRecycleCache()->objects[recycler];
+    if (objects.empty()) return nullptr;
+    void* object = objects.back();
+    objects.pop_back();
+    reused_.fetch_add(1, std::memory_order_relaxed);
+    return object;
+  }
 
-    for (int64_t slot = 0; slot < item_count_; ++slot) {
-      auto& item = items_[slot];
-      Epoch priorItemEpoch = item.removal_epoch;
-      if (priorItemEpoch == 0 || priorItemEpoch == invalid_epoch) {
-        // Someone is modifying this slot. Try elsewhere.
+  /// Have Scavenge() and the reclaimer destroy expired items pushed with
+  /// \a callback through \a bulk, one call per batch of items that share a
+  /// context, instead of calling \a callback once per item. Push() still
+  /// reclaims through \a callback. Call before pushing concurrently.
+  bool RegisterBulkCallback(DestroyCallback callback,
+                            BulkDestroyCallback bulk) {
+    if (!callback || !bulk || bulk_callback_count_ == kMaxBulkCallbacks) {
+      return false;
+    }
+    bulk_callbacks_[bulk_callback_count_++] = BulkCallback{callback, bulk};
+    return true;
+  }
+
+  RecycleStats GetRecycleStats() {
+    return RecycleStats{recycled_.load(std::memory_order_relaxed),
+                        reused_.load(std::memory_order_relaxed)};
+  }
+
+ private:
+  /// Push() accounting \a bytes, applying the overflow policy.
+  bool PushSized(void* removed_item, DestroyCallback callback, void* context,
+                 uint64_t bytes) {
+    // With the reclaimer running the first lap only takes empty slots.
+    uint64_t lap = reclaimer_running_.load(std::memory_order_relaxed)
+                       ? 2 * item_count_
+                       : item_count_;
+    auto timeout = std::chrono::microseconds(50);
+    for (;;) {
+      if (overflow_depth_.load(std::memory_order_relaxed)) {
+        DrainOverflow();
+        if (overflow_depth_.load(std::memory_order_relaxed)) {
+          // The ring is most likely still pinned, don't walk all of it.
+          if (TryPush(removed_item, callback, context, kOverflowProbes,
+                      bytes)) {
+            return true;
+          }
+          PushOverflow(removed_item, callback, context, bytes);
+          return true;
+        }
+      }
+
+      if (TryPush(removed_item, callback, context, lap, bytes)) return true;
+      full_laps_.fetch_add(1, std::memory_order_relaxed);
+
+      switch (overflow_policy_) {
+        case OverflowPolicy::kSpin:
+          break;
+        case OverflowPolicy::kOverflow:
+          PushOverflow(removed_item, callback, context, bytes);
+          return true;
+        case OverflowPolicy::kBlock:
+          blocked_.fetch_add(1, std::memory_order_relaxed);
+          if (!epoch_manager_->WaitForEpochAdvance(timeout)) {
+            timeout = std::min(timeout * 2, std::chrono::microseconds(10000));
+          }
+          break;
+        case OverflowPolicy::kFail:
+          failed_.fetch_add(1, std::memory_order_relaxed);
+          return false;
+      }
+    }
+  }
+
+  /// Destroy every item on the ring and clear its slot, ignoring epochs, with
+  /// the ring split across \a thread_count threads. See Recovery().
+  RecoveryStats RecoverItems(uint32_t thread_count) {
+    auto start = std::chrono::steady_clock::now();
+    // Ranges cover whole cache lines, i.e. pairs of items.
+    uint64_t max_threads = std::max<uint64_t>(item_count_ / 1024, 1);
+    uint64_t threads = std::min<uint64_t>(std::max(thread_count, 1u),
+                                          max_threads);
+    uint64_t range = ((item_count_ + threads - 1) / threads + 1) & ~1llu;
+
+    std::atomic<uint64_t> reclaimed{0};
+    auto recover = [this, &reclaimed](uint64_t begin, uint64_t end) {
+      reclaimed.fetch_add(RecoverRange(begin, end), std::memory_order_relaxed);
+    };
+    std::vector<std::thread> workers;
+    for (uint64_t i = 1; i < threads; ++i) {
+      workers.emplace_back(recover, std::min(i * range, item_count_),
+                           std::min((i + 1) * range, item_count_));
+    }
+    recover(0, std::min(range, item_count_));
+    for (auto& worker : workers) worker.join();
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return RecoveryStats{
+        reclaimed.load(),
+        static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+                .count()),
+        static_cast<uint32_t>(threads)};
+  }
+
+  /// Recover the slots in [\a begin, \a end); \a begin is even. All-zero
+  /// cache lines, the common case in a mostly reclaimed ring, are skipped
+  /// with one vector test. Returns the number of items destroyed.
+  uint64_t RecoverRange(uint64_t begin, uint64_t end) {
+    uint64_t reclaimed = 0;
+    for (uint64_t i = begin; i < end; ++i) {
+#ifdef __AVX__
+      if (((i & 1) == 0) && i + 1 < end) {
+        __m256i line = _mm256_or_si256(
+            _mm256_load_si256(reinterpret_cast<__m256i*>(&items_[i])),
+            _mm256_load_si256(reinterpret_cast<__m256i*>(&items_[i + 1])));
+        if (_mm256_testz_si256(line, line)) {
+          ++i;
+          continue;
+        }
+      }
+#endif
+      Item& item = items_[i];
+      if (item.removed_item == nullptr) continue;
+      item.destroy_callback(item.destroy_callback_context, item.removed_item);
+      if constexpr (Storage::kPersistent) {
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(&items_[i]),
+                            _mm256_setzero_si256());
+      } else {
+        new (&items_[i]) Item{};
+      }
+      reclaimed += 1;
+    }
+    if constexpr (Storage::kPersistent) _mm_sfence();
+    return reclaimed;
+  }
+
+  /// Lock \a slot by swapping its removal_epoch for #invalid_epoch and
+  /// destroy the item it held, or copy it to \a expired for the caller to
+  /// destroy (\a expired->removed_item is nullptr if there is none). Returns
+  /// false, leaving the slot untouched, if someone else holds the slot or its
+  /// item is not safe to reclaim yet, or if it holds an item at all and
+  /// \a reclaim is not set.
+  bool ClaimSlot(int64_t slot, bool reclaim = true, Item* expired = nullptr) {
+    Item& item = items_[slot];
+    if (expired) expired->removed_item = nullptr;
+    bool recovering = recovering_.load(std::memory_order_acquire);
+
+    Epoch priorItemEpoch = item.removal_epoch;
+    if (priorItemEpoch == invalid_epoch) {
+      // Someone is modifying this slot, or the previous run was and crashed.
+      if (!recovering || !reclaim) return false;
+      return ClaimLeftoverSlot(slot, expired);
+    }
+    if (priorItemEpoch && !reclaim) {
+      // Leave the destruction to the reclaimer thread.
+      return false;
+    }
+
+    Epoch result = CompareExchange64<Epoch>(&item.removal_epoch, invalid_epoch,
+                                            priorItemEpoch);
+    if (result != priorItemEpoch) {
+      // Someone else is now modifying the slot or it has been
+      // replaced with a new item. If someone replaces the old item
+      // with a new one of the same epoch number, that's ok.
+      return false;
+    }
+
+    // Items the previous run left behind are safe to reclaim whatever their
+    // epoch says.
+    bool leftover = false;
+    if (recovering) {
+      uint64_t state = MarkSlot(slot, kSlotClaimed);
+      if (state & kSlotClaimed) {
+        // ClaimLeftoverSlot() took the slot over while we held it, and
+        // reclaims its item.
+        return false;
+      }
+      leftover = !(state & kSlotWritten);
+    }
+
+    // Ensure it is safe to free the old entry.
+    if (priorItemEpoch) {
+      if (!leftover && !epoch_manager_->IsSafeToReclaim(priorItemEpoch)) {
+        // Uh-oh, we couldn't free the old entry. Things aren't looking
+        // good, but maybe it was just the result of a race. Replace the
+        // epoch number we mangled and try elsewhere.
+        if (recovering) UnmarkSlot(slot, kSlotClaimed);
+        *((volatile Epoch*)&item.removal_epoch) = priorItemEpoch;
+        return false;
+      }
+      if (leftover) recovered_.fetch_add(1, std::memory_order_relaxed);
+      if (expired) {
+        *expired = item;
+      } else {
+        DestroyItem(item);
+      }
+      if (item_bytes_ && item_bytes_[slot]) {
+        retired_bytes_.fetch_sub(item_bytes_[slot], std::memory_order_relaxed);
+        item_bytes_[slot] = 0;
+      }
+    }
+    return true;
+  }
+
+  /// Take over \a slot if the previous run crashed while holding it, e.g.
+  /// with a ReserveItem() in flight, and reclaim its item. Nobody in this
+  /// run can tell such a slot from one it holds by the epoch, so the slot
+  /// state decides: a slot never claimed nor written in this run is a
+  /// leftover, and marking it claimed first wins it. A claimer that locked
+  /// the slot through its epoch but had not marked it yet backs off.
+  bool ClaimLeftoverSlot(int64_t slot, Item* expired) {
+    if (SlotState(slot)) return false;
+    if (MarkSlot(slot, kSlotClaimed)) return false;
+
+    Item& item = items_[slot];
+    if (item.removed_item) {
+      recovered_.fetch_add(1, std::memory_order_relaxed);
+      if (expired) {
+        *expired = item;
+      } else {
+        DestroyItem(item);
+      }
+    }
+    return true;
+  }
+
+  /// Recovery state of \a slot, kSlotWritten and kSlotClaimed bits.
+  uint64_t SlotState(uint64_t slot) {
+    return (slot_states_[slot >> 5].load(std::memory_order_acquire) >>
+            ((slot & 31) * 2)) &
+           3;
+  }
+
+  /// Set \a bits in the state of \a slot; returns its previous state.
+  uint64_t MarkSlot(uint64_t slot, uint64_t bits) {
+    uint32_t shift = (slot & 31) * 2;
+    return (slot_states_[slot >> 5].fetch_or(bits << shift,
+                                             std::memory_order_acq_rel) >>
+            shift) &
+           3;
+  }
+
+  void UnmarkSlot(uint64_t slot, uint64_t bits) {
+    slot_states_[slot >> 5].fetch_and(~(bits << ((slot & 31) * 2)),
+                                      std::memory_order_acq_rel);
+  }
+
+  /// A slot claimed in this run is being unlocked with a new item.
+  void MarkSlotWritten(uint64_t slot) {
+    MarkSlot(slot, kSlotWritten);
+    UnmarkSlot(slot, kSlotClaimed);
+  }
+
+  /// Set up the slot states for LazyRecovery(); every slot starts out as a
+  /// possible leftover.
+  bool BeginLazyRecovery() {
+    free(slot_states_);
+    slot_states_ = reinterpret_cast<std::atomic<uint64_t>*>(
+        calloc((item_count_ + 31) / 32, sizeof(uint64_t)));
+    if (!slot_states_) return false;
+    recovery_cursor_ = 0;
+    recovery_remaining_ = item_count_;
+    recovered_ = 0;
+    recovering_ = true;
+    return true;
+  }
+
+  /// Walk from #reclaim_cursor_ towards the pushers, destroying expired items,
+  /// until \a max_slots occupied slots have been looked at. Pushers stamp
+  /// their epoch before taking a slot, and Push() leaves items of an earlier
+  /// lap in place, so items are only roughly in epoch order: the walk stops
+  /// at the first item that is not safe yet, since the ones after it seldom
+  /// are, and leaves the rest to the next walk. Slots somebody holds, e.g.
+  /// through ReserveItem(), are stepped over, but the cursor, the watermark
+  /// below which everything has been reclaimed, stays at the first of them.
+  /// So do empty slots: their pusher may have taken the position from
+  /// #tail_ without having claimed the slot yet. An empty slot that stays
+  /// empty keeps the cursor until the pushers lap it.
+  /// Returns the number of items destroyed and sets \a advanced_slots to the
+  /// number of slots the cursor moved.
+  uint64_t ReclaimExpired(uint64_t max_slots, uint64_t* advanced_slots) {
+    int64_t start = reclaim_cursor_.load(std::memory_order_relaxed);
+    int64_t cursor = start;
+    // Slots below tail_ - 1 have been handed out to pushers.
+    int64_t end = tail_.load(std::memory_order_acquire) - 1;
+    if (end - cursor > static_cast<int64_t>(item_count_)) {
+      // Lapped by the pushers, which reclaimed those slots themselves.
+      cursor = end - item_count_;
+    }
+
+    Item batch[kDestroyBatch];
+    uint32_t batched = 0;
+    uint64_t occupied = 0;
+    uint64_t reclaimed = 0;
+    bool held = false;
+    int64_t watermark = cursor;
+    for (; occupied < max_slots && cursor < end; ++cursor) {
+      int64_t slot = cursor & (item_count_ - 1);
+      Epoch epoch = items_[slot].removal_epoch;
+      if (epoch == 0) {
+        if (!held) watermark = cursor;
+        held = true;
+        continue;
+      }
+      occupied += 1;
+      if (epoch != invalid_epoch && !epoch_manager_->IsSafeToReclaim(epoch)) {
+        epoch_manager_->RequestEpochAdvance();
+        break;
+      }
+      if (epoch == invalid_epoch || !ClaimSlot(slot, true, &batch[batched])) {
+        if (!held) watermark = cursor;
+        held = true;
         continue;
       }
+      WriteSlot(slot, nullptr, nullptr, nullptr, 0);
+      if (!batch[batched].removed_item) continue;
+      reclaimed += 1;
+      if (++batched == kDestroyBatch) {
+        DestroyBatch(batch, batched);
+        batched = 0;
+      }
+    }
+    if (!held) watermark = cursor;
+    reclaim_cursor_.store(watermark, std::memory_order_relaxed);
+    DestroyBatch(batch, batched);
+    *advanced_slots = watermark - start;
+    return reclaimed;
+  }
+
+  /// Destroy \a count expired items grouped by callback and context: each
+  /// group goes to its bulk callback in one call if one is registered (see
+  /// RegisterBulkCallback()), else item by item with the next items
+  /// prefetched. Sorts \a items.
+  void DestroyBatch(Item* items, uint32_t count) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      if (!RecycleItem(items[i])) items[kept++] = items[i];
+    }
+    count = kept;
+    std::sort(items, items + count, [](const Item& a, const Item& b) {
+      if (a.destroy_callback != b.destroy_callback) {
+        return std::less<DestroyCallback>()(a.destroy_callback,
+                                            b.destroy_callback);
+      }
+      return std::less<void*>()(a.destroy_callback_context,
+                                b.destroy_callback_context);
+    });
 
-      Epoch result = CompareExchange64<Epoch>(&item.removal_epoch,
-                                              invalid_epoch, priorItemEpoch);
-      if (result != priorItemEpoch) {
-        // Someone else is now modifying the slot or it has been
-        // replaced with a new item. If someone replaces the old item
-        // with a new one of the same epoch number, that's ok.
+    void* objects[kDestroyBatch];
+    uint32_t begin = 0;
+    while (begin < count) {
+      DestroyCallback callback = items[begin].destroy_callback;
+      void* context = items[begin].destroy_callback_context;
+      uint32_t n = 0;
+      while (begin + n < count && items[begin + n].destroy_callback == callback &&
+             items[begin + n].destroy_callback_context == context) {
+        objects[n] = items[begin + n].removed_item;
+        ++n;
+      }
+      begin += n;
+
+      BulkDestroyCallback bulk = nullptr;
+      for (uint32_t i = 0; i < bulk_callback_count_; ++i) {
+        if (bulk_callbacks_[i].callback == callback) {
+          bulk = bulk_callbacks_[i].bulk;
+          break;
+        }
+      }
+      if (bulk) {
+        bulk(context, objects, n);
         continue;
       }
+      for (uint32_t i = 0; i < n; ++i) {
+        if (i + kPrefetchDistance < n) {
+          _mm_prefetch(reinterpret_cast<const char*>(
+                           objects[i + kPrefetchDistance]),
+                       _MM_HINT_T0);
+        }
+        callback(context, objects[i]);
+      }
+    }
+  }
 
-      if (priorItemEpoch) {
-        if (!epoch_manager_->IsSafeToReclaim(priorItemEpoch)) {
-          // Uh-oh, we couldn't free the old entry. Things aren't looking
-          // good, but maybe it was just the result of a race. Replace the
-          // epoch number we mangled and try elsewhere.
-          *((volatile Epoch*)&item.removal_epoch) = priorItemEpoch;
-          continue;
+  /// Destroy an expired item, or park it in the calling thread's recycle
+  /// cache if a recycler is registered for it and the cache has room.
+  void DestroyItem(const Item& item) {
+    if (RecycleItem(item)) return;
+    item.destroy_callback(item.destroy_callback_context, item.removed_item);
+  }
+
+  /// Park an expired item in the calling thread's recycle cache. Returns
+  /// false if no recycler is registered for it or the cache is full.
+  bool RecycleItem(const Item& item) {
+    for (uint32_t i = 0; i < recycler_count_ && !tls_no_recycle_; ++i) {
+      Recycler& recycler = recyclers_[i];
+      if (recycler.callback != item.destroy_callback ||
+          recycler.context != item.destroy_callback_context) {
+        continue;
+      }
+      auto& objects = GetRecycleCache()->objects[i];
+      if (objects.size() < recycler.max_cached) {
+        objects.push_back(item.removed_item);
+        recycled_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+      break;
+    }
+    return false;
+  }
+
+  /// Objects a thread keeps for reuse, one list per recycler. Handed to the
+  /// next thread that needs a cache when its owner exits.
+  struct RecycleCache {
+    /// pthread_self() of the owner, 0 while the cache waits for adoption.
+    std::atomic<uint64_t> thread_id;
+    std::vector<void*> objects[kMaxRecyclers];
+  };
+
+  /// Returns the calling thread's recycle cache: cached in TLS, else adopted
+  /// from an exited thread, else a new one. See
+  /// IntervalGarbageList::GetListForThread().
+  RecycleCache* GetRecycleCache() {
+    ThreadSlots::Slot* slot = ThreadSlots::Find(recycle_id_);
+    if (slot) return reinterpret_cast<RecycleCache*>(slot->value);
+    slot = ThreadSlots::Claim(recycle_id_);
+
+    uint64_t thread_id = pthread_self();
+    RecycleCache* cache = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(recycle_mutex_);
+      if (!slot) {
+        for (RecycleCache* candidate : recycle_caches_) {
+          if (candidate->thread_id.load(std::memory_order_relaxed) ==
+              thread_id) {
+            return candidate;
+          }
         }
-        item.destroy_callback(item.destroy_callback_context, item.removed_item);
       }
+      for (RecycleCache* candidate : recycle_caches_) {
+        uint64_t expected = 0;
+        if (candidate->thread_id.compare_exchange_strong(
+                expected, thread_id, std::memory_order_acquire)) {
+          cache = candidate;
+          break;
+        }
+      }
+      if (!cache) {
+        cache = new RecycleCache{};
+        cache->thread_id = thread_id;
+        recycle_caches_.push_back(cache);
+      }
+    }
 
-      // Now reset the entry
-      Item stack_item;
-      stack_item.destroy_callback = nullptr;
-      stack_item.destroy_callback_context = nullptr;
-      stack_item.removed_item = nullptr;
-      *((volatile Epoch*)&stack_item.removal_epoch) = 0;
-#ifdef PMEM
-      auto value =
-          _mm256_set_epi64x((int64_t)0, (int64_t)0, (int64_t)0, (int64_t)0);
-      _mm256_stream_si256((__m256i*)(items_ + slot), value);
-#else
-      items_[slot] = stack_item;
-#endif
+    uint64_t* tls = nullptr;
+    if (slot) {
+      slot->value = reinterpret_cast<uint64_t>(cache);
+      tls = &slot->owner;
     }
+    Thread::RegisterTls(tls, 0, &BasicGarbageList::ReleaseRecycleCache, cache);
+    return cache;
+  }
 
-    return scavenged;
+  /// Thread exit callback: leave the cache for the next thread to adopt.
+  static void ReleaseRecycleCache(void* cache) {
+    reinterpret_cast<RecycleCache*>(cache)->thread_id.store(
+        0, std::memory_order_release);
   }
 
-  /// Returns (a pointer to) the epoch manager associated with this garbage
-  /// list.
-  EpochManager* GetEpoch() { return epoch_manager_; }
+  /// Destroy every cached object and free the caches.
+  void ReleaseRecycleCaches() {
+    if (recycle_id_) ThreadSlots::ReleaseOwner(recycle_id_);
+    std::unique_lock<std::mutex> lock(recycle_mutex_);
+    for (RecycleCache* cache : recycle_caches_) {
+      // Threads that have not exited yet must not call back into freed caches.
+      Thread::UnregisterTlsInRange(cache, cache + 1);
+      for (uint32_t i = 0; i < recycler_count_; ++i) {
+        for (void* object : cache->objects[i]) {
+          recyclers_[i].callback(recyclers_[i].context, object);
+        }
+      }
+      delete cache;
+    }
+    recycle_caches_.clear();
+    recycler_count_ = 0;
+    recycle_id_ = 0;
+  }
+
+  /// Park an item on the overflow list, see OverflowPolicy::kOverflow.
+  void PushOverflow(void* removed_item, DestroyCallback callback,
+                    void* context, uint64_t bytes) {
+    OverflowItem overflow{
+        Item{epoch_manager_->GetCurrentEpoch(), callback, context,
+             removed_item},
+        bytes};
+    if (bytes) retired_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(overflow_mutex_);
+    overflow_.push_back(overflow);
+    overflow_depth_.fetch_add(1, std::memory_order_relaxed);
+    overflowed_.fetch_add(1, std::memory_order_relaxed);
+    epoch_manager_->RequestEpochAdvance();
+  }
+
+  /// Destroy the overflow items that are safe to reclaim. Skipped if another
+  /// thread is at it. Returns the number of items destroyed.
+  uint64_t DrainOverflow() {
+    std::vector<OverflowItem> ready;
+    {
+      std::unique_lock<std::mutex> lock(overflow_mutex_, std::try_to_lock);
+      if (!lock.owns_lock()) return 0;
+      auto pinned = std::partition(
+          overflow_.begin(), overflow_.end(),
+          [this](const OverflowItem& overflow) {
+            return !epoch_manager_->IsSafeToReclaim(
+                overflow.item.removal_epoch);
+          });
+      ready.assign(pinned, overflow_.end());
+      overflow_.erase(pinned, overflow_.end());
+      overflow_depth_.store(overflow_.size(), std::memory_order_relaxed);
+    }
+    Item batch[kDestroyBatch];
+    uint32_t batched = 0;
+    for (auto& overflow : ready) {
+      batch[batched++] = overflow.item;
+      if (batched == kDestroyBatch) {
+        DestroyBatch(batch, batched);
+        batched = 0;
+      }
+      if (overflow.bytes) {
+        retired_bytes_.fetch_sub(overflow.bytes, std::memory_order_relaxed);
+      }
+    }
+    DestroyBatch(batch, batched);
+    return ready.size();
+  }
+
+  /// Hold a push of \a bytes back until it fits under #max_bytes_, or until
+  /// nothing is left to reclaim if it is larger than the cap on its own, see
+  /// SetByteThresholds().
+  void ThrottleBytes(uint64_t bytes) {
+    throttled_.fetch_add(1, std::memory_order_relaxed);
+    auto timeout = std::chrono::microseconds(50);
+    for (;;) {
+      Scavenge();
+      uint64_t retired = retired_bytes_.load(std::memory_order_relaxed);
+      if (retired + bytes <= max_bytes_ || retired == 0 ||
+          epoch_manager_->IsProtected()) {
+        return;
+      }
+      if (!epoch_manager_->WaitForEpochAdvance(timeout)) {
+        timeout = std::min(timeout * 2, std::chrono::microseconds(10000));
+      }
+    }
+  }
+
+  /// Fill a slot locked by ClaimSlot(); this also unlocks it.
+  void WriteSlot(int64_t slot, void* removed_item, DestroyCallback callback,
+                 void* context, Epoch removal_epoch, uint64_t bytes = 0) {
+    if (recovering_.load(std::memory_order_acquire)) MarkSlotWritten(slot);
+
+    if (bytes && item_bytes_) {
+      item_bytes_[slot] = bytes;
+      retired_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    Item stack_item;
+    stack_item.destroy_callback = callback;
+    stack_item.destroy_callback_context = context;
+    stack_item.removed_item = removed_item;
+    *((volatile Epoch*)&stack_item.removal_epoch) = removal_epoch;
+
+    if constexpr (Storage::kPersistent) {
+      auto value = _mm256_set_epi64x((int64_t)removed_item, (int64_t)context,
+                                     (int64_t)callback, (int64_t)removal_epoch);
+      _mm256_stream_si256((__m256i*)(items_ + slot), value);
+    } else {
+      items_[slot] = stack_item;
+    }
+  }
 
- private:
 #ifdef TEST_BUILD
   FRIEND_TEST(GarbageListPMTest, ReserveMemory);
+  FRIEND_TEST(GarbageListTest, RecoverItems);
+  FRIEND_TEST(GarbageListTest, LazyRecovery);
+  FRIEND_TEST(GarbageListTest, ScavengeSlowPusher);
 #endif
   /// EpochManager instance that is used to determine when it is safe to
   /// free up items. Specifically, it is used to stamp items during Push()
@@ -455,7 +1539,274 @@ class GarbageList : public IGarbageList {
   /// if possible.
   Item* items_;
 
+  /// Where #items_ was allocated from, see Initialize().
+  Storage storage_;
+
+  /// Background thread destroying expired items, see StartReclaimer().
+  /// nullptr unless started.
+  std::thread* reclaimer_;
+  std::atomic<bool> reclaimer_running_;
+  uint64_t reclaim_batch_;
+
+  /// Next (unmasked) ring position Scavenge() or the reclaimer visits;
+  /// trails #tail_. Concurrent walkers may move it back, which only makes
+  /// them revisit slots.
+  std::atomic<int64_t> reclaim_cursor_;
+
+  /// Items destroyed by the reclaimer.
+  std::atomic<uint64_t> reclaimed_;
+
+  std::mutex reclaimer_mutex_;
+  std::condition_variable reclaimer_cv_;
+
+  OverflowPolicy overflow_policy_;
+
+  /// Items pushed while the ring was pinned, see OverflowPolicy::kOverflow.
+  /// Lives in DRAM even with persistent storage: a crash leaks these items
+  /// instead of reclaiming them on Recovery().
+  struct OverflowItem {
+    Item item;
+    uint64_t bytes;
+  };
+  std::mutex overflow_mutex_;
+  std::vector<OverflowItem> overflow_;
+  std::atomic<uint64_t> overflow_depth_;
+
+  /// See OverflowStats.
+  std::atomic<uint64_t> full_laps_;
+  std::atomic<uint64_t> overflowed_;
+  std::atomic<uint64_t> blocked_;
+  std::atomic<uint64_t> failed_;
+
+  /// Bytes of the item in each slot, in DRAM next to #items_ so that the
+  /// items keep their layout. nullptr until SetByteThresholds().
+  uint64_t* item_bytes_;
+
+  /// Bytes held by items not reclaimed yet, ring and overflow list.
+  std::atomic<uint64_t> retired_bytes_;
+
+  /// Bytes pushed so far; every #advance_bytes_ of them roll the epoch over.
+  std::atomic<uint64_t> bytes_since_advance_;
+  uint64_t advance_bytes_;
+  uint64_t max_bytes_;
+  std::atomic<uint64_t> throttled_;
+
+  /// See RegisterRecycler().
+  struct Recycler {
+    DestroyCallback callback;
+    void* context;
+    uint64_t max_cached;
+  };
+  Recycler recyclers_[kMaxRecyclers];
+  uint32_t recycler_count_;
+
+  /// Every recycle cache handed out so far, owned or not.
+  std::mutex recycle_mutex_;
+  std::vector<RecycleCache*> recycle_caches_;
+
+  /// Identifies this list in ThreadSlots, where the calling thread's recycle
+  /// cache is kept; 0 until a recycler is registered.
+  uint64_t recycle_id_;
+
+  std::atomic<uint64_t> recycled_;
+  std::atomic<uint64_t> reused_;
+
+  /// See RegisterBulkCallback().
+  struct BulkCallback {
+    DestroyCallback callback;
+    BulkDestroyCallback bulk;
+  };
+  BulkCallback bulk_callbacks_[kMaxBulkCallbacks];
+  uint32_t bulk_callback_count_;
+
+  /// Slot states while leftovers of a LazyRecovery() may remain: two bits
+  /// per slot, in DRAM and so all clear after the restart.
+  enum : uint64_t {
+    /// The slot was unlocked with a new item (or none) in this run.
+    kSlotWritten = 1,
+    /// The slot is held by someone in this run.
+    kSlotClaimed = 2,
+  };
+  std::atomic<uint64_t>* slot_states_;
+  std::atomic<bool> recovering_;
+
+  /// Next slot a RecoverStep() sweeps, and slots not swept yet.
+  std::atomic<uint64_t> recovery_cursor_;
+  std::atomic<uint64_t> recovery_remaining_;
+  std::atomic<uint64_t> recovered_;
+
+  static thread_local bool tls_no_recycle_;
+};
+
+template <typename Storage>
+thread_local bool BasicGarbageList<Storage>::tls_no_recycle_ = false;
+
+typedef BasicGarbageList<DramStorage> DramGarbageList;
+typedef BasicGarbageList<MmapStorage> MmapGarbageList;
 #ifdef PMEM
-  PMEMobjpool* pmdk_pool_;
+typedef BasicGarbageList<PmdkStorage> PmdkGarbageList;
+typedef PmdkGarbageList GarbageList;
+#else
+typedef DramGarbageList GarbageList;
 #endif
+
+/// GarbageList split into shards that share one EpochManager. Every Push()
+/// goes to the calling thread's home shard (picked by hashing its id), so
+/// threads no longer contend on a single #GarbageList::tail_ cache line.
+/// When the home shard holds nothing reclaimable after probing a quarter of
+/// its ring (which also rolls the epoch over once), the push steals a slot
+/// from the other shards in turn before trying again.
+template <typename Storage>
+class BasicShardedGarbageList : public IGarbageList {
+ public:
+  typedef BasicGarbageList<Storage> Shard;
+
+  /// Upper bound on the number of shards.
+  static const uint32_t kMaxShards = 64;
+
+  BasicShardedGarbageList() : shard_count_{} {}
+
+  virtual ~BasicShardedGarbageList() { Uninitialize(); }
+
+  /// Initialize \a shard_count shards of \a item_count / \a shard_count items
+  /// each. \a shard_count is rounded down to a power of two no larger than
+  /// #kMaxShards; 0 picks one shard per hardware thread. Every shard applies
+  /// \a overflow_policy once all of them are pinned. Shard i allocates its
+  /// ring from \a storage.ForShard(i). Calling this on an initialized list
+  /// has no effect.
+  bool Initialize(EpochManager* epoch_manager, const Storage& storage,
+                  size_t item_count = 128 * 1024, uint32_t shard_count = 0,
+                  typename Shard::OverflowPolicy overflow_policy =
+                      Shard::OverflowPolicy::kSpin) {
+    if (shard_count_) return true;
+    if (!epoch_manager || !item_count || !IS_POWER_OF_TWO(item_count)) {
+      return false;
+    }
+
+    if (!shard_count) shard_count = std::thread::hardware_concurrency();
+    shard_count = std::min<uint32_t>(std::max<uint32_t>(shard_count, 1),
+                                     kMaxShards);
+    while (!IS_POWER_OF_TWO(shard_count)) shard_count &= shard_count - 1;
+    // Keep every ring big enough for the quarter-ring probes of TryPush().
+    while (shard_count > 1 && item_count / shard_count < 64) shard_count >>= 1;
+
+    for (uint32_t i = 0; i < shard_count; ++i) {
+      if (!shards_[i].Initialize(epoch_manager, storage.ForShard(i),
+                                 item_count / shard_count, overflow_policy)) {
+        for (uint32_t j = 0; j < i; ++j) shards_[j].Uninitialize();
+        return false;
+      }
+    }
+    shard_count_ = shard_count;
+    return true;
+  }
+
+  /// Initialize() with a default constructed \a Storage, e.g. in DRAM.
+  virtual bool Initialize(EpochManager* epoch_manager,
+                          size_t item_count = 128 * 1024,
+                          uint32_t shard_count = 0,
+                          typename Shard::OverflowPolicy overflow_policy =
+                              Shard::OverflowPolicy::kSpin) {
+    return Initialize(epoch_manager, Storage{}, item_count, shard_count,
+                      overflow_policy);
+  }
+
+  /// Uninitialize every shard, destroying all items still on them. See
+  /// GarbageList::Uninitialize().
+  virtual bool Uninitialize() {
+    for (uint32_t i = 0; i < shard_count_; ++i) shards_[i].Uninitialize();
+    shard_count_ = 0;
+    return true;
+  }
+
+  /// See GarbageList::Push(). Unless the overflow policy is kSpin, the home
+  /// shard applies it once no shard has a reclaimable slot.
+  virtual bool Push(void* removed_item, DestroyCallback callback,
+                    void* context) {
+    uint32_t home = HomeShard();
+    for (;;) {
+      for (uint32_t i = 0; i < shard_count_; ++i) {
+        Shard& shard = shards_[(home + i) & (shard_count_ - 1)];
+        if (shard.TryPush(removed_item, callback, context,
+                          shard.GetItemCount() / 4)) {
+          return true;
+        }
+      }
+      if (shards_[home].GetOverflowPolicy() != Shard::OverflowPolicy::kSpin) {
+        return shards_[home].Push(removed_item, callback, context);
+      }
+    }
+  }
+
+  /// See GarbageList::ReserveItem(); reserves from the home shard.
+  typename Shard::Item* ReserveItem() {
+    return shards_[HomeShard()].ReserveItem();
+  }
+
+  /// See GarbageList::ResetItem(); hands \a item back to the shard it was
+  /// reserved from. Returns false if no shard owns it.
+  bool ResetItem(typename Shard::Item* item) {
+    for (uint32_t i = 0; i < shard_count_; ++i) {
+      if (shards_[i].OwnsItem(item)) return shards_[i].ResetItem(item);
+    }
+    return false;
+  }
+
+  /// Recover every shard, see GarbageList::Recovery(). \a stats adds up
+  /// the shards.
+  bool Recovery(EpochManager* epoch_manager, const Storage& storage,
+                uint32_t thread_count = 1,
+                typename Shard::RecoveryStats* stats = nullptr) {
+    typename Shard::RecoveryStats total{0, 0, 0};
+    for (uint32_t i = 0; i < shard_count_; ++i) {
+      typename Shard::RecoveryStats shard{};
+      if (!shards_[i].Recovery(epoch_manager, storage.ForShard(i),
+                               thread_count, &shard)) {
+        return false;
+      }
+      total.reclaimed += shard.reclaimed;
+      total.elapsed_us += shard.elapsed_us;
+      total.threads = std::max(total.threads, shard.threads);
+    }
+    if (stats) *stats = total;
+    return true;
+  }
+
+  /// Scavenge every shard, see GarbageList::Scavenge().
+  int32_t Scavenge() {
+    int32_t scavenged = 0;
+    for (uint32_t i = 0; i < shard_count_; ++i) {
+      scavenged += shards_[i].Scavenge();
+    }
+    return scavenged;
+  }
+
+  EpochManager* GetEpoch() {
+    return shard_count_ ? shards_[0].GetEpoch() : nullptr;
+  }
+
+  uint32_t GetShardCount() { return shard_count_; }
+
+ private:
+  /// The shard the calling thread pushes to first.
+  uint32_t HomeShard() {
+    return Murmur3_64(pthread_self()) & (shard_count_ - 1);
+  }
+
+#ifdef TEST_BUILD
+  FRIEND_TEST(ShardedGarbageListTest, ResetItemOfOtherShard);
+#endif
+
+  /// Number of initialized entries of #shards_, a power of two.
+  uint32_t shard_count_;
+
+  /// Kept inline, like the ring pointer of a single GarbageList, so that a
+  /// list living in persistent memory can find its shards on recovery.
+  Shard shards_[kMaxShards];
 };
+
+#ifdef PMEM
+typedef BasicShardedGarbageList<PmdkStorage> ShardedGarbageList;
+#else
+typedef BasicShardedGarbageList<DramStorage> ShardedGarbageList;
+#endif
@@ -56,7 +56,8 @@ class GarbageListUnsafe : public IGarbageList {
   static_assert(std::is_pod<Item>::value, "Item should be POD");
 
   /// Construct a GarbageList in an uninitialized state.
-  GarbageListUnsafe() : epoch_manager_{}, tail_{}, item_count_{}, items_{} {}
+  GarbageListUnsafe()
+      : epoch_manager_{}, tail_{}, scavenge_head_{}, item_count_{}, items_{} {}
 
   /// Uninitialize the GarbageList (if still initialized) and destroy it.
   virtual ~GarbageListUnsafe() { Uninitialize(); }
@@ -102,6 +103,7 @@ class GarbageListUnsafe : public IGarbageList {
 
     item_count_ = item_count;
     tail_ = 0;
+    scavenge_head_ = 0;
     epoch_manager_ = epoch_manager;
 
     return true;
@@ -135,6 +137,7 @@ class GarbageListUnsafe : public IGarbageList {
 
     items_ = nullptr;
     tail_ = 0;
+    scavenge_head_ = 0;
     item_count_ = 0;
     epoch_manager_ = nullptr;
 
@@ -176,7 +179,7 @@ class GarbageListUnsafe : public IGarbageList {
       // Everytime we work through 25% of the capacity of the list roll
       // the epoch over.
       if (((slot << 2) & (item_count_ - 1)) == 0)
-        epoch_manager_->BumpCurrentEpoch();
+        epoch_manager_->RequestEpochAdvance();
 
       Item& item = items_[slot];
 
@@ -214,32 +217,29 @@ class GarbageListUnsafe : public IGarbageList {
   /// wait until the garbage list is full. Currently (May 2016) the only user is
   /// MwCAS' descriptor pool which we'd like to keep small. Tedious to tune the
   /// descriptor pool size vs. garbage list size, so there is this function.
+  ///
+  /// Walks from where the last scavenge stopped towards the tail, and stops at
+  /// the first item that is not safe yet: items are pushed in epoch order, so
+  /// everything after it is younger. Returns the number of items destroyed.
   int32_t Scavenge() {
     const uint64_t invalid_epoch = ~0llu;
-    auto max_slot = tail_;
     int32_t scavenged = 0;
 
-    for (int64_t slot = 0; slot < item_count_; ++slot) {
-      auto& item = items_[slot];
+    if (tail_ - scavenge_head_ > static_cast<int64_t>(item_count_)) {
+      // Lapped by Push(), which reclaimed those slots itself.
+      scavenge_head_ = tail_ - item_count_;
+    }
+
+    for (; scavenge_head_ < tail_; ++scavenge_head_) {
+      auto& item = items_[scavenge_head_ & (item_count_ - 1)];
       Epoch priorItemEpoch = item.removal_epoch;
-      if (priorItemEpoch == 0 || priorItemEpoch == invalid_epoch) {
-        // Someone is modifying this slot. Try elsewhere.
-        continue;
-      }
+#ifdef TEST_BUILD
+      RAW_CHECK(priorItemEpoch != invalid_epoch, "invalid priorItemEpoch");
+#endif
+      if (priorItemEpoch == 0) continue;
+      if (!epoch_manager_->IsSafeToReclaim(priorItemEpoch)) break;
 
-      // No synchronization for a single thread; guaranteed to succeed
-      item.removal_epoch = invalid_epoch;
-
-      if (priorItemEpoch) {
-        if (!epoch_manager_->IsSafeToReclaim(priorItemEpoch)) {
-          // Uh-oh, we couldn't free the old entry. Things aren't looking
-          // good, but maybe it was just the result of a race. Replace the
-          // epoch number we mangled and try elsewhere.
-          *((volatile Epoch*)&item.removal_epoch) = priorItemEpoch;
-          continue;
-        }
-        item.destroy_callback(item.destroy_callback_context, item.removed_item);
-      }
+      item.destroy_callback(item.destroy_callback_context, item.removed_item);
 
       // Now reset the entry
       item.destroy_callback = nullptr;
@@ -268,6 +268,10 @@ class GarbageListUnsafe : public IGarbageList {
   /// Atomically incremented within Push().
   int64_t tail_;
 
+  /// Position in the ring up to which Scavenge() has reclaimed everything;
+  /// trails #tail_.
+  int64_t scavenge_head_;
+
   /// Size of the #m_items array. Must be a power of two.
   size_t item_count_;
 
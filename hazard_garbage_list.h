@@ -0,0 +1,384 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "garbage_list.h"
+
+/// Hazard pointer based alternative to GarbageList. Instead of entering an
+/// epoch, readers publish each pointer they are about to dereference in one of
+/// their hazard slots (see Protect()). Removed items are parked in a per-thread
+/// retired list, and once that list reaches the retire threshold the pushing
+/// thread scans every hazard slot and destroys the retired items nobody
+/// protects. A stalled reader therefore only pins the handful of items it
+/// points at, never the whole list: a thread's retired list never grows past
+/// the threshold, and Push() never waits on other threads. Threads that find
+/// every record taken retire into a shared list instead, see Push().
+///
+/// The price is on the read side: Protect() is a store plus a full fence per
+/// pointer, where an epoch is one store per operation. Pick this backend for
+/// structures whose readers may stall or whose garbage must stay bounded.
+class HazardPointerGarbageList : public IGarbageList {
+ public:
+  /// Hazard slots per thread; Protect() takes an index below this.
+  static const uint32_t kHazardsPerThread = 4;
+
+  /// Default number of threads that can use the list at the same time.
+  static const uint64_t kDefaultMaxThreads = 128;
+
+  /// An item retired by its thread, waiting for no hazard to point at it.
+  struct Item {
+    void* removed_item;
+    DestroyCallback destroy_callback;
+    void* destroy_callback_context;
+  };
+
+  /// The hazard slots of one thread, padded to a cache line. Only the owning
+  /// thread writes #hazards and #retired; scanners only read #hazards.
+  struct HazardRecord {
+    std::atomic<void*> hazards[kHazardsPerThread];
+
+    /// pthread_self() of the owner, 0 while the record is free.
+    std::atomic<uint64_t> thread_id;
+
+    /// Items retired by the owner and not reclaimed yet. Left in place when
+    /// the owner exits, the next owner inherits them.
+    std::vector<Item>* retired;
+
+    char ___padding[16];
+  };
+  static_assert(sizeof(HazardRecord) == 64, "Unexpected hazard record size");
+
+  HazardPointerGarbageList()
+      : epoch_manager_{},
+        records_{},
+        max_threads_{},
+        retire_threshold_{},
+        id_{} {}
+
+  virtual ~HazardPointerGarbageList() { Uninitialize(); }
+
+  /// Allocate the hazard records. \a epoch_manager is not needed by this
+  /// backend and only kept for GetEpoch(); it may be nullptr. Calling this on
+  /// an initialized list has no effect.
+  ///
+  /// \param max_threads
+  ///      Number of threads that may hold a hazard record at once. Records of
+  ///      exited Thread instances are handed back.
+  virtual bool Initialize(EpochManager* epoch_manager,
+                          size_t max_threads = kDefaultMaxThreads);
+
+  /// Destroy every retired item, protected or not, and release the records.
+  /// The caller guarantees that no thread accesses the items any more.
+  virtual bool Uninitialize();
+
+  /// Retire \a removed_item; \a callback is invoked on it once no hazard slot
+  /// points at it. Scans the hazard slots every #retire_threshold_ pushes of
+  /// the calling thread. If every record is taken, the item goes to a shared
+  /// list, under a lock, which is scanned the same way.
+  virtual bool Push(void* removed_item, DestroyCallback callback,
+                    void* context);
+
+  /// Load \a source into \a protected_ptr and publish it in the calling
+  /// thread's hazard slot \a index, re-reading until the published value is
+  /// still current. The object stays live until the slot is cleared or
+  /// overwritten, even if it is concurrently removed and pushed.
+  template <typename T>
+  bool Protect(uint32_t index, const std::atomic<T*>& source,
+               T** protected_ptr) {
+    HazardRecord* record = nullptr;
+    if (!GetRecordForThread(&record)) return false;
+
+    T* ptr = source.load(std::memory_order_relaxed);
+    for (;;) {
+      // The re-read must not be satisfied before the hazard is visible to
+      // scanners, hence the seq_cst store.
+      record->hazards[index].store(ptr, std::memory_order_seq_cst);
+      T* current = source.load(std::memory_order_seq_cst);
+      if (current == ptr) break;
+      ptr = current;
+    }
+    *protected_ptr = ptr;
+    return true;
+  }
+
+  /// Release the calling thread's hazard slot \a index.
+  bool Clear(uint32_t index) {
+    HazardRecord* record = nullptr;
+    if (!GetRecordForThread(&record)) return false;
+    record->hazards[index].store(nullptr, std::memory_order_release);
+    return true;
+  }
+
+  /// Release all of the calling thread's hazard slots.
+  bool ClearAll() {
+    HazardRecord* record = nullptr;
+    if (!GetRecordForThread(&record)) return false;
+    for (auto& hazard : record->hazards) {
+      hazard.store(nullptr, std::memory_order_release);
+    }
+    return true;
+  }
+
+  /// Reclaim the calling thread's retired items that no hazard points at,
+  /// along with those of the shared list and of records whose owner exited.
+  /// Returns the number of items destroyed.
+  int32_t Scavenge();
+
+  EpochManager* GetEpoch() { return epoch_manager_; }
+
+ private:
+#ifdef TEST_BUILD
+  FRIEND_TEST(HazardPointerGarbageListTest, ReleaseRecordOnThreadExit);
+  FRIEND_TEST(HazardPointerGarbageListTest, ScavengeTakesNoRecord);
+#endif
+
+  /// HazardRecord::thread_id of a free record swept by Scavenge(), which
+  /// keeps others from reserving it meanwhile.
+  static const uint64_t kSweeping = ~0ull;
+
+  bool GetRecordForThread(HazardRecord** record);
+  HazardRecord* LookupRecordForThread();
+  void CollectHazards(std::vector<void*>* hazards);
+  static int32_t ReclaimUnprotected(std::vector<Item>* retired,
+                                    const std::vector<void*>& hazards);
+  HazardRecord* FindRecord(uint64_t thread_id);
+  HazardRecord* ReserveRecord(uint64_t thread_id);
+  static void ReleaseRecord(void* record);
+
+  EpochManager* epoch_manager_;
+
+  /// One record per thread using the list, #max_threads_ of them.
+  HazardRecord* records_;
+  uint64_t max_threads_;
+
+  /// Retired items per thread that trigger a scan. Twice the number of
+  /// hazard slots, so that every scan reclaims at least half of the list.
+  uint64_t retire_threshold_;
+
+  /// Items pushed by threads that could not get a record.
+  std::mutex shared_mutex_;
+  std::vector<Item> shared_retired_;
+
+  /// Identifies this list in ThreadSlots, where the calling thread's record
+  /// is cached.
+  uint64_t id_;
+};
+
+bool HazardPointerGarbageList::Initialize(EpochManager* epoch_manager,
+                                          size_t max_threads) {
+  if (records_) return true;
+  if (!max_threads) return false;
+
+  void* mem = nullptr;
+  if (posix_memalign(&mem, 64, sizeof(HazardRecord) * max_threads)) {
+    return false;
+  }
+  records_ = reinterpret_cast<HazardRecord*>(mem);
+  for (size_t i = 0; i < max_threads; ++i) {
+    HazardRecord* record = new (&records_[i]) HazardRecord{};
+    record->retired = new std::vector<Item>();
+  }
+
+  max_threads_ = max_threads;
+  retire_threshold_ = 2 * kHazardsPerThread * max_threads;
+  id_ = ThreadSlots::AcquireOwner();
+  epoch_manager_ = epoch_manager;
+  return true;
+}
+
+bool HazardPointerGarbageList::Uninitialize() {
+  if (!records_) return true;
+
+  ThreadSlots::ReleaseOwner(id_);
+  // Threads that have not exited yet must not call back into freed records.
+  Thread::UnregisterTlsInRange(records_, records_ + max_threads_);
+
+  for (uint64_t i = 0; i < max_threads_; ++i) {
+    for (auto& item : *records_[i].retired) {
+      item.destroy_callback(item.destroy_callback_context, item.removed_item);
+    }
+    delete records_[i].retired;
+  }
+  free(records_);
+  for (auto& item : shared_retired_) {
+    item.destroy_callback(item.destroy_callback_context, item.removed_item);
+  }
+  shared_retired_.clear();
+
+  records_ = nullptr;
+  max_threads_ = 0;
+  retire_threshold_ = 0;
+  epoch_manager_ = nullptr;
+  return true;
+}
+
+bool HazardPointerGarbageList::Push(void* removed_item,
+                                    DestroyCallback callback, void* context) {
+  HazardRecord* record = nullptr;
+  size_t retired = 0;
+  if (GetRecordForThread(&record)) {
+    record->retired->push_back(Item{removed_item, callback, context});
+    retired = record->retired->size();
+  } else {
+    // More threads than records: this one cannot hold hazards, but its
+    // garbage must not be dropped.
+    std::unique_lock<std::mutex> lock(shared_mutex_);
+    shared_retired_.push_back(Item{removed_item, callback, context});
+    retired = shared_retired_.size();
+  }
+  if (retired >= retire_threshold_) {
+    Scavenge();
+  }
+  return true;
+}
+
+/// Collect every published hazard, then destroy the retired items that are
+/// not among them. The items were unlinked before they were pushed, so a
+/// reader that publishes one of them after the hazards were collected fails
+/// its re-read in Protect() and never dereferences it.
+int32_t HazardPointerGarbageList::Scavenge() {
+  std::vector<void*> hazards;
+  CollectHazards(&hazards);
+
+  int32_t scavenged = 0;
+  // A thread that only scavenges has nothing of its own to reclaim and must
+  // not take a record from one that reads.
+  HazardRecord* record = LookupRecordForThread();
+  if (record) {
+    scavenged += ReclaimUnprotected(record->retired, hazards);
+  }
+
+  // Records left by exited threads keep their items until the next owner
+  // comes along, which may be never; sweep them while nobody holds them.
+  for (uint64_t i = 0; i < max_threads_; ++i) {
+    HazardRecord& orphan = records_[i];
+    uint64_t expected = 0;
+    if (orphan.thread_id.load(std::memory_order_relaxed) != 0 ||
+        !orphan.thread_id.compare_exchange_strong(
+            expected, kSweeping, std::memory_order_acquire)) {
+      continue;
+    }
+    scavenged += ReclaimUnprotected(orphan.retired, hazards);
+    orphan.thread_id.store(0, std::memory_order_release);
+  }
+
+  std::unique_lock<std::mutex> lock(shared_mutex_, std::try_to_lock);
+  if (lock.owns_lock()) {
+    scavenged += ReclaimUnprotected(&shared_retired_, hazards);
+  }
+  return scavenged;
+}
+
+/// Returns every published hazard, sorted.
+void HazardPointerGarbageList::CollectHazards(std::vector<void*>* hazards) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  hazards->reserve(kHazardsPerThread * max_threads_);
+  for (uint64_t i = 0; i < max_threads_; ++i) {
+    for (auto& hazard : records_[i].hazards) {
+      void* ptr = hazard.load(std::memory_order_acquire);
+      if (ptr) hazards->push_back(ptr);
+    }
+  }
+  std::sort(hazards->begin(), hazards->end());
+}
+
+/// Destroy the items of \a retired that are not in \a hazards, keeping the
+/// rest. Returns the number of items destroyed.
+int32_t HazardPointerGarbageList::ReclaimUnprotected(
+    std::vector<Item>* retired, const std::vector<void*>& hazards) {
+  int32_t scavenged = 0;
+  size_t kept = 0;
+  for (size_t i = 0; i < retired->size(); ++i) {
+    Item& item = (*retired)[i];
+    if (std::binary_search(hazards.begin(), hazards.end(),
+                           item.removed_item)) {
+      (*retired)[kept++] = item;
+      continue;
+    }
+    item.destroy_callback(item.destroy_callback_context, item.removed_item);
+    scavenged += 1;
+  }
+  retired->resize(kept);
+  return scavenged;
+}
+
+/// Returns the record the calling thread holds, nullptr if none; unlike
+/// GetRecordForThread() never reserves one.
+HazardPointerGarbageList::HazardRecord*
+HazardPointerGarbageList::LookupRecordForThread() {
+  ThreadSlots::Slot* slot = ThreadSlots::Find(id_);
+  if (slot) return reinterpret_cast<HazardRecord*>(slot->value);
+  return FindRecord(pthread_self());
+}
+
+bool HazardPointerGarbageList::GetRecordForThread(HazardRecord** record) {
+  ThreadSlots::Slot* slot = ThreadSlots::Find(id_);
+  if (slot) {
+    *record = reinterpret_cast<HazardRecord*>(slot->value);
+    return true;
+  }
+
+  slot = ThreadSlots::Claim(id_);
+  if (!slot) {
+    HazardRecord* found = FindRecord(pthread_self());
+    if (found) {
+      *record = found;
+      return true;
+    }
+  }
+
+  HazardRecord* reserved = ReserveRecord(pthread_self());
+  if (!reserved) {
+    if (slot) *slot = ThreadSlots::Slot{};
+    return false;
+  }
+  *record = reserved;
+
+  uint64_t* tls = nullptr;
+  if (slot) {
+    slot->value = reinterpret_cast<uint64_t>(reserved);
+    tls = &slot->owner;
+  }
+  Thread::RegisterTls(tls, 0, &HazardPointerGarbageList::ReleaseRecord,
+                      reserved);
+  return true;
+}
+
+/// Returns the record owned by \a thread_id, or nullptr if it holds none.
+HazardPointerGarbageList::HazardRecord* HazardPointerGarbageList::FindRecord(
+    uint64_t thread_id) {
+  for (uint64_t i = 0; i < max_threads_; ++i) {
+    if (records_[i].thread_id.load(std::memory_order_relaxed) == thread_id) {
+      return &records_[i];
+    }
+  }
+  return nullptr;
+}
+
+/// Claim a free record for \a thread_id, probing from its hash. Returns
+/// nullptr if #max_threads_ threads already hold one.
+HazardPointerGarbageList::HazardRecord*
+HazardPointerGarbageList::ReserveRecord(uint64_t thread_id) {
+  uint64_t start = Murmur3_64(thread_id);
+  for (uint64_t i = 0; i < max_threads_; ++i) {
+    HazardRecord& record = records_[(start + i) % max_threads_];
+    uint64_t expected = 0;
+    if (record.thread_id.load(std::memory_order_relaxed) == 0 &&
+        record.thread_id.compare_exchange_strong(expected, thread_id,
+                                                 std::memory_order_acquire)) {
+      return &record;
+    }
+  }
+  return nullptr;
+}
+
+/// Thread exit callback: drop the exiting thread's hazards and free its
+/// record. Its retired items stay for the next owner.
+void HazardPointerGarbageList::ReleaseRecord(void* record) {
+  auto* hazard_record = reinterpret_cast<HazardRecord*>(record);
+  for (auto& hazard : hazard_record->hazards) {
+    hazard.store(nullptr, std::memory_order_relaxed);
+  }
+  hazard_record->thread_id.store(0, std::memory_order_release);
+}
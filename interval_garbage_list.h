@@ -0,0 +1,244 @@
+#pragma once
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "garbage_list.h"
+
+/// Interval-based (2GE-IBR) counterpart of GarbageList. Every item carries the
+/// epoch it was allocated in (its birth) next to the epoch it was removed in,
+/// and is reclaimed as soon as its [birth, retire] lifetime does not overlap
+/// the reservation interval of any protected thread (see
+/// EpochManager::kIntervalBased). Unlike plain epochs, a thread stalled inside
+/// Protect() only pins the items that were alive while it was reading, so
+/// garbage stays bounded under preempted threads.
+///
+/// Requires an EpochManager initialized with kIntervalBased, and readers that
+/// fetch shared pointers through EpochManager::ProtectPointer(). Objects must
+/// be stamped with GetCurrentEpoch() when they are allocated, and pushed with
+/// PushWithBirth(); Push() treats the item as born in epoch 0, which degrades
+/// to plain epoch-based reclamation for that item.
+///
+/// Items are kept in per-thread lists and reclaimed in batches: every
+/// #retire_threshold_ pushes the pushing thread collects the reservations
+/// once and sweeps its list.
+class IntervalGarbageList : public IGarbageList {
+ public:
+  /// Items a thread retires before it sweeps its list.
+  static const uint64_t kDefaultRetireThreshold = 1024;
+
+  /// A retired object and its lifetime.
+  struct Item {
+    /// Epoch in which the object was allocated, or 0 if unknown.
+    Epoch birth_epoch;
+
+    /// Epoch in which the object was removed from the data structure; see
+    /// GarbageList::Item::removal_epoch.
+    Epoch removal_epoch;
+
+    DestroyCallback destroy_callback;
+    void* destroy_callback_context;
+    void* removed_item;
+  };
+
+  IntervalGarbageList() : epoch_manager_{}, retire_threshold_{}, id_{} {}
+
+  virtual ~IntervalGarbageList() { Uninitialize(); }
+
+  /// Associate the list with \a epoch_manager, which must run in
+  /// kIntervalBased mode; returns false otherwise. Calling this on an
+  /// initialized list has no effect.
+  ///
+  /// \param retire_threshold
+  ///      Items a thread retires before it sweeps its list. Must not be 0.
+  virtual bool Initialize(EpochManager* epoch_manager,
+                          size_t retire_threshold = kDefaultRetireThreshold);
+
+  /// Destroy every item still on the list, ignoring reservations. The caller
+  /// guarantees no thread accesses them any more.
+  virtual bool Uninitialize();
+
+  /// Retire \a removed_item with an unknown birth epoch.
+  virtual bool Push(void* removed_item, DestroyCallback callback,
+                    void* context) {
+    return PushWithBirth(removed_item, 0, callback, context);
+  }
+
+  /// Retire \a removed_item, allocated in \a birth_epoch (as returned by
+  /// EpochManager::GetCurrentEpoch() at allocation time).
+  bool PushWithBirth(void* removed_item, Epoch birth_epoch,
+                     DestroyCallback callback, void* context);
+
+  /// Destroy the calling thread's items whose lifetime overlaps no
+  /// reservation. Returns the number of items destroyed.
+  int32_t Scavenge();
+
+  EpochManager* GetEpoch() { return epoch_manager_; }
+
+ private:
+#ifdef TEST_BUILD
+  FRIEND_TEST(IntervalGarbageListTest, AdoptListOfExitedThread);
+#endif
+
+  /// Items retired by one thread. Handed to the next thread that needs a list
+  /// when its owner exits.
+  struct RetiredList {
+    /// pthread_self() of the owner, 0 while the list waits for adoption.
+    std::atomic<uint64_t> thread_id;
+    std::vector<Item> items;
+    uint64_t pushes;
+  };
+
+  RetiredList* GetListForThread();
+  static void ReleaseList(void* list);
+
+  EpochManager* epoch_manager_;
+  uint64_t retire_threshold_;
+
+  /// Every list handed out so far, owned or not. Only touched under
+  /// #lists_mutex_, when a thread gets its first list.
+  std::mutex lists_mutex_;
+  std::vector<RetiredList*> lists_;
+
+  /// Identifies this list in ThreadSlots, where the calling thread's
+  /// retired list is cached.
+  uint64_t id_;
+};
+
+bool IntervalGarbageList::Initialize(EpochManager* epoch_manager,
+                                     size_t retire_threshold) {
+  if (epoch_manager_) return true;
+  if (!epoch_manager || !retire_threshold) return false;
+  // Without reservations every item would look safe to reclaim.
+  if (!epoch_manager->IsIntervalBased()) return false;
+
+  retire_threshold_ = retire_threshold;
+  id_ = ThreadSlots::AcquireOwner();
+  epoch_manager_ = epoch_manager;
+  return true;
+}
+
+bool IntervalGarbageList::Uninitialize() {
+  if (!epoch_manager_) return true;
+
+  ThreadSlots::ReleaseOwner(id_);
+
+  std::unique_lock<std::mutex> lock(lists_mutex_);
+  for (RetiredList* list : lists_) {
+    // Threads that have not exited yet must not call back into freed lists.
+    Thread::UnregisterTlsInRange(list, list + 1);
+    for (auto& item : list->items) {
+      item.destroy_callback(item.destroy_callback_context, item.removed_item);
+    }
+    delete list;
+  }
+  lists_.clear();
+
+  retire_threshold_ = 0;
+  epoch_manager_ = nullptr;
+  return true;
+}
+
+bool IntervalGarbageList::PushWithBirth(void* removed_item, Epoch birth_epoch,
+                                        DestroyCallback callback,
+                                        void* context) {
+  RetiredList* list = GetListForThread();
+  Epoch removal_epoch = epoch_manager_->GetCurrentEpoch();
+  list->items.push_back(
+      Item{birth_epoch, removal_epoch, callback, context, removed_item});
+
+  // Everytime we work through 25% of the threshold roll the epoch over, so
+  // lifetimes and reservations stay fine grained.
+  if (++list->pushes % std::max<uint64_t>(retire_threshold_ / 4, 1) == 0) {
+    epoch_manager_->RequestEpochAdvance();
+  }
+  if (list->items.size() >= retire_threshold_) {
+    Scavenge();
+  }
+  return true;
+}
+
+/**
+ * Sweep the calling thread's list against one snapshot of the reservations.
+ * Every item on the list was unlinked before the snapshot, so a thread that
+ * opens or extends its reservation afterwards can no longer reach it.
+ */
+int32_t IntervalGarbageList::Scavenge() {
+  RetiredList* list = GetListForThread();
+
+  std::vector<EpochManager::Reservation> reservations;
+  epoch_manager_->GetReservations(&reservations);
+
+  int32_t scavenged = 0;
+  auto& items = list->items;
+  size_t kept = 0;
+  for (size_t i = 0; i < items.size(); ++i) {
+    Item& item = items[i];
+    bool reserved = false;
+    for (auto& reservation : reservations) {
+      if (reservation.lower <= item.removal_epoch &&
+          reservation.upper >= item.birth_epoch) {
+        reserved = true;
+        break;
+      }
+    }
+    if (reserved) {
+      items[kept++] = item;
+      continue;
+    }
+    item.destroy_callback(item.destroy_callback_context, item.removed_item);
+    scavenged += 1;
+  }
+  items.resize(kept);
+  return scavenged;
+}
+
+/// Returns the calling thread's list: cached in TLS, else adopted from an
+/// exited thread, else a new one.
+IntervalGarbageList::RetiredList* IntervalGarbageList::GetListForThread() {
+  ThreadSlots::Slot* slot = ThreadSlots::Find(id_);
+  if (slot) return reinterpret_cast<RetiredList*>(slot->value);
+  slot = ThreadSlots::Claim(id_);
+
+  uint64_t thread_id = pthread_self();
+  RetiredList* list = nullptr;
+  {
+    std::unique_lock<std::mutex> lock(lists_mutex_);
+    if (!slot) {
+      // This thread uses more lists than it can cache.
+      for (RetiredList* candidate : lists_) {
+        if (candidate->thread_id.load(std::memory_order_relaxed) ==
+            thread_id) {
+          return candidate;
+        }
+      }
+    }
+    for (RetiredList* candidate : lists_) {
+      uint64_t expected = 0;
+      if (candidate->thread_id.compare_exchange_strong(
+              expected, thread_id, std::memory_order_acquire)) {
+        list = candidate;
+        break;
+      }
+    }
+    if (!list) {
+      list = new RetiredList{};
+      list->thread_id = thread_id;
+      lists_.push_back(list);
+    }
+  }
+
+  uint64_t* tls = nullptr;
+  if (slot) {
+    slot->value = reinterpret_cast<uint64_t>(list);
+    tls = &slot->owner;
+  }
+  Thread::RegisterTls(tls, 0, &IntervalGarbageList::ReleaseList, list);
+  return list;
+}
+
+/// Thread exit callback: leave the list, with whatever it still holds, for the
+/// next thread to adopt.
+void IntervalGarbageList::ReleaseList(void* list) {
+  reinterpret_cast<RetiredList*>(list)->thread_id.store(
+      0, std::memory_order_release);
+}
@@ -3,6 +3,7 @@
 //
 // Persistent CAS
 #pragma once
+#include <cstring>
 #include "utils.h"
 
 #ifdef TEST_BUILD
@@ -125,11 +126,88 @@ DirtyTable* DirtyTable::table_{nullptr};
 ///   We typically don't need to, because on recovery we'll be able to redo
 ///   the CAS. This requires later writers to flush the old value before
 ///   install new values.
+struct DirtyTablePolicy {
+  static uint64_t CAS(void* addr, uint64_t old_v, uint64_t new_v) {
+    DirtyTable::GetInstance()->RegisterItem(addr, old_v, new_v);
+    __atomic_compare_exchange_n((uint64_t*)addr, &old_v, new_v, false,
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return old_v;
+  }
+
+  /// A plain load: a value that is not persisted yet is redone from the
+  /// DirtyTable on recovery.
+  static uint64_t Read(void* addr) {
+    return __atomic_load_n((uint64_t*)addr, __ATOMIC_ACQUIRE);
+  }
+};
+
+/// Needs no DirtyTable slot: the new value is installed with its dirty bit
+/// set, flushed, then the bit is cleared. Anyone that sees a dirty value,
+/// reader or writer, flushes and clears it before using it, so no thread acts
+/// on a value that could be lost in a crash.
+///
+/// A dirty value found after a restart was already in persistent memory, the
+/// first PersistentRead() just clears it, there is no recovery step.
+///
+/// The top bit of the value is reserved, and every read of a word updated
+/// this way must go through PersistentRead().
+struct DirtyBitPolicy {
+  static const constexpr uint64_t kDirtyBitMask = 0x8000000000000000ull;
+
+  static uint64_t CAS(void* addr, uint64_t old_v, uint64_t new_v) {
+    uint64_t* target = (uint64_t*)addr;
+    uint64_t dirty_value = new_v | kDirtyBitMask;
+    while (true) {
+      uint64_t seen = CompareExchange64(target, dirty_value, old_v);
+      if (seen == old_v) {
+        Persist(target, dirty_value);
+        return old_v;
+      }
+      if ((seen & kDirtyBitMask) == 0) {
+        return seen;
+      }
+      // Someone else's value is not persisted yet, help it and retry if it
+      // is the one we expect.
+      Persist(target, seen);
+      if ((seen & ~kDirtyBitMask) != old_v) {
+        return seen & ~kDirtyBitMask;
+      }
+    }
+  }
+
+  static uint64_t Read(void* addr) {
+    uint64_t* target = (uint64_t*)addr;
+    uint64_t value = __atomic_load_n(target, __ATOMIC_ACQUIRE);
+    if (value & kDirtyBitMask) {
+      Persist(target, value);
+      value &= ~kDirtyBitMask;
+    }
+    return value;
+  }
+
+ private:
+  /// Flush the dirty \a value at \a addr and clear its dirty bit; fails
+  /// harmlessly if another thread already did.
+  static void Persist(uint64_t* addr, uint64_t value) {
+    flush(addr);
+    fence();
+    CompareExchange64(addr, value & ~kDirtyBitMask, value);
+  }
+};
+
+/// Persistent CAS through \a Policy, returns the value seen at \a addr, i.e.
+/// it succeeded if that equals \a old_v. A policy provides
+///   static uint64_t CAS(void* addr, uint64_t old_v, uint64_t new_v);
+///   static uint64_t Read(void* addr);
+template <typename Policy = DirtyTablePolicy>
 static uint64_t PersistentCAS(void* addr, uint64_t old_v, uint64_t new_v) {
-  DirtyTable::GetInstance()->RegisterItem(addr, old_v, new_v);
-  __atomic_compare_exchange_n((uint64_t*)addr, &old_v, new_v, false,
-                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
-  return old_v;
+  return Policy::CAS(addr, old_v, new_v);
+}
+
+/// Read a word updated with PersistentCAS() of the same \a Policy.
+template <typename Policy = DirtyTablePolicy>
+static uint64_t PersistentRead(void* addr) {
+  return Policy::Read(addr);
 }
 
 }  // namespace pm_tool
@@ -0,0 +1,516 @@
+// Copyright Xiangpeng Hao. All rights reserved.
+// Licensed under the MIT license.
+//
+// Persistent multi-word CAS
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "epoch_manager.h"
+#include "garbage_list_unsafe.h"
+#include "utils.h"
+
+#ifdef TEST_BUILD
+#include <glog/logging.h>
+#include <glog/raw_logging.h>
+#include <gtest/gtest_prod.h>
+#endif
+
+namespace very_pm {
+
+class Descriptor;
+class DescriptorPool;
+
+/// One word changed by a PMwCAS.
+struct WordDescriptor {
+  uint64_t* address_;
+  uint64_t old_;
+  uint64_t new_;
+
+  /// The descriptor this word belongs to, see Descriptor::CompleteInstall().
+  Descriptor* parent_;
+};
+
+/// A persistent multi-word CAS, after Wang et al., "Easy Lock-Free Indexing
+/// in Non-Volatile Memory" (ICDE 2018). Take one from a DescriptorPool, add
+/// the words with AddWord() and run it with MwCAS(): either every word
+/// changes from its old to its new value, or none does, and the outcome
+/// survives a crash at any point.
+///
+/// Why is PersistentCAS not enough?
+///   A DirtyTable entry can redo one CAS, but a multi-word change needs all
+///   of its words to agree on the outcome. Here the descriptor is the log:
+///   it is persisted before it is installed in any word, and on recovery
+///   every word that still points to it is rolled forward or back according
+///   to its persisted status.
+///
+/// How does it work?
+///   1. Every target word, in address order, is swapped for a pointer to the
+///      descriptor (through a small RDCSS, so that the swap only lands while
+///      the descriptor is undecided).
+///   2. The status is set to succeeded if all words were installed, failed
+///      otherwise, and persisted.
+///   3. Every word is swapped for its new or old value.
+///   Threads that run into a descriptor help it along instead of waiting.
+///   Every value written is first tagged dirty, and whoever reads a dirty
+///   word flushes it and clears the tag before acting on it, so nobody acts
+///   on a value that might be lost in a crash.
+///
+/// Target words must leave the top three bits clear, and every access to
+/// them must go through PMwCASRead() from inside the EpochManager's
+/// protected region of the pool.
+class alignas(kCacheLineSize) Descriptor {
+ public:
+  static const constexpr uint32_t kMaxWords = 4;
+
+  /// Flags kept in the top bits of target words, see the class comment.
+  static const constexpr uint64_t kDirtyFlag = 1ull << 63;
+  static const constexpr uint64_t kMwCASFlag = 1ull << 62;
+  static const constexpr uint64_t kRDCSSFlag = 1ull << 61;
+  static const constexpr uint64_t kFlagMask =
+      kDirtyFlag | kMwCASFlag | kRDCSSFlag;
+
+  enum Status : uint64_t {
+    kStatusFree = 0,
+    kStatusUndecided = 1,
+    kStatusSucceeded = 2,
+    kStatusFailed = 3,
+  };
+
+  /// Change \a addr from \a old_v to \a new_v as part of this PMwCAS. Returns
+  /// false if the descriptor is full, \a addr was already added, or a value
+  /// uses the flag bits.
+  bool AddWord(uint64_t* addr, uint64_t old_v, uint64_t new_v) {
+    if (count_ == kMaxWords || ((old_v | new_v) & kFlagMask)) return false;
+    for (uint32_t i = 0; i < count_; ++i) {
+      if (words_[i].address_ == addr) return false;
+    }
+    words_[count_++] = WordDescriptor{addr, old_v, new_v, this};
+    return true;
+  }
+
+  /// Persist the descriptor, run it and hand it back to its pool. Must be
+  /// called from inside the protected region, by the thread that allocated
+  /// the descriptor. Returns true if every word changed.
+  bool MwCAS() {
+    std::sort(words_, words_ + count_,
+              [](const WordDescriptor& a, const WordDescriptor& b) {
+                return std::less<uint64_t*>()(a.address_, b.address_);
+              });
+    Persist();
+    bool succeeded = Run();
+    Retire();
+    return succeeded;
+  }
+
+  /// Hand the descriptor back to its pool without running it.
+  void Abort() { Retire(); }
+
+  /// Read a target word, helping along any PMwCAS in flight on it.
+  static uint64_t Read(uint64_t* addr) {
+    for (;;) {
+      uint64_t value = __atomic_load_n(addr, __ATOMIC_ACQUIRE);
+      if (value & kRDCSSFlag) {
+        CompleteInstall(reinterpret_cast<WordDescriptor*>(value & ~kFlagMask));
+        continue;
+      }
+      if (value & kDirtyFlag) {
+        PersistWord(addr, value);
+        value &= ~kDirtyFlag;
+      }
+      if (value & kMwCASFlag) {
+        reinterpret_cast<Descriptor*>(value & ~kFlagMask)->Run();
+        continue;
+      }
+      return value;
+    }
+  }
+
+ private:
+  friend class DescriptorPool;
+#ifdef TEST_BUILD
+  FRIEND_TEST(PMwCASTest, Recovery);
+#endif
+
+  /// Drive the PMwCAS to completion; run by the owner and by every helper.
+  /// Returns true if it succeeded.
+  bool Run() {
+    uint64_t me = reinterpret_cast<uint64_t>(this) | kMwCASFlag;
+    uint64_t status = ReadStatus();
+    if (status == kStatusUndecided) {
+      status = kStatusSucceeded;
+      for (uint32_t i = 0; i < count_ && status == kStatusSucceeded; ++i) {
+        WordDescriptor* word = &words_[i];
+        for (;;) {
+          uint64_t value = InstallWord(word);
+          if (value == word->old_ || (value & ~kDirtyFlag) == me) break;
+          if (value & kDirtyFlag) {
+            PersistWord(word->address_, value);
+            continue;
+          }
+          if (value & kMwCASFlag) {
+            // Addresses are installed in order, so helping never cycles.
+            reinterpret_cast<Descriptor*>(value & ~kFlagMask)->Run();
+            continue;
+          }
+          status = kStatusFailed;
+          break;
+        }
+      }
+
+      // Every installed word must be durable before the outcome is.
+      if (status == kStatusSucceeded) {
+        for (uint32_t i = 0; i < count_; ++i) {
+          PersistWord(words_[i].address_, me | kDirtyFlag);
+        }
+      }
+      CompareExchange64<uint64_t>(&status_, status | kDirtyFlag,
+                                  kStatusUndecided);
+      status = ReadStatus();
+    }
+
+    bool succeeded = status == kStatusSucceeded;
+    for (uint32_t i = 0; i < count_; ++i) {
+      WordDescriptor& word = words_[i];
+      uint64_t value = (succeeded ? word.new_ : word.old_) | kDirtyFlag;
+      if (CompareExchange64<uint64_t>(word.address_, value, me) ==
+          (me | kDirtyFlag)) {
+        CompareExchange64<uint64_t>(word.address_, value, me | kDirtyFlag);
+      }
+      PersistWord(word.address_, value);
+    }
+    return succeeded;
+  }
+
+  /// Swap \a word's target for a pointer to \a word if it holds the old
+  /// value, then for the descriptor if that is still undecided (RDCSS).
+  /// Returns what the target held before.
+  static uint64_t InstallWord(WordDescriptor* word) {
+    uint64_t ptr = reinterpret_cast<uint64_t>(word) | kRDCSSFlag;
+    for (;;) {
+      uint64_t value = CompareExchange64(word->address_, ptr, word->old_);
+      if (value & kRDCSSFlag) {
+        CompleteInstall(reinterpret_cast<WordDescriptor*>(value & ~kFlagMask));
+        continue;
+      }
+      if (value == word->old_) CompleteInstall(word);
+      return value;
+    }
+  }
+
+  /// Second half of InstallWord(), may be run by any thread that finds the
+  /// word pointer in the target.
+  static void CompleteInstall(WordDescriptor* word) {
+    uint64_t mwcas =
+        reinterpret_cast<uint64_t>(word->parent_) | kMwCASFlag | kDirtyFlag;
+    bool undecided = word->parent_->ReadStatus() == kStatusUndecided;
+    CompareExchange64(word->address_, undecided ? mwcas : word->old_,
+                      reinterpret_cast<uint64_t>(word) | kRDCSSFlag);
+  }
+
+  /// Flush \a addr, which held \a value, and clear its dirty flag.
+  static void PersistWord(uint64_t* addr, uint64_t value) {
+    flush(addr);
+    fence();
+    CompareExchange64(addr, value & ~kDirtyFlag, value);
+  }
+
+  /// The status, persisted first if it is dirty.
+  uint64_t ReadStatus() {
+    uint64_t status = __atomic_load_n(&status_, __ATOMIC_ACQUIRE);
+    if (status & kDirtyFlag) PersistWord(&status_, status);
+    return status & ~kDirtyFlag;
+  }
+
+  /// Flush the whole descriptor, words included.
+  void Persist() {
+    for (char* line = reinterpret_cast<char*>(this);
+         line < reinterpret_cast<char*>(this + 1); line += kCacheLineSize) {
+      flush(line);
+    }
+    fence();
+  }
+
+  inline void Retire();
+
+  uint64_t status_;
+  uint32_t count_;
+
+  /// The pool the descriptor goes back to; only meaningful until a crash.
+  DescriptorPool* pool_;
+
+  /// The DescriptorPool::Partition it was allocated from, which takes it
+  /// back when it is retired.
+  void* partition_;
+
+  WordDescriptor words_[kMaxWords];
+};
+
+/// Read a word that is the target of PMwCASes, see Descriptor::Read().
+static uint64_t PMwCASRead(void* addr) {
+  return Descriptor::Read(reinterpret_cast<uint64_t*>(addr));
+}
+
+/// Hands out the Descriptors of an array in persistent memory, and takes
+/// them back once no thread can still be helping them. Every thread
+/// allocates from its own partition: a free list plus a GarbageListUnsafe
+/// that holds its retired descriptors until the EpochManager deems them
+/// safe, neither of which needs any synchronization. Partitions of exited
+/// Thread instances are handed to the next thread, with their descriptors.
+class DescriptorPool {
+ public:
+  /// Default number of threads that can use the pool at the same time.
+  static const uint32_t kDefaultPartitions = 64;
+
+  DescriptorPool()
+      : epoch_manager_{},
+        descriptors_{},
+        descriptor_count_{},
+        partitions_{},
+        partition_count_{},
+        id_{} {}
+
+  ~DescriptorPool() { Uninitialize(); }
+
+  /// Take over \a descriptor_count descriptors at \a descriptors, usually in
+  /// persistent memory, and spread them over \a partition_count partitions.
+  /// Every descriptor is reset: after a crash, run Recovery() on the array
+  /// first. Calling this on an initialized pool has no effect.
+  bool Initialize(EpochManager* epoch_manager, Descriptor* descriptors,
+                  uint32_t descriptor_count,
+                  uint32_t partition_count = kDefaultPartitions);
+
+  /// Release the partitions. The caller guarantees that no PMwCAS is in
+  /// flight.
+  bool Uninitialize();
+
+  /// Finish the PMwCASes a crash interrupted, DirtyTable::Recovery() style:
+  /// every word still holding a descriptor is rolled forward if that
+  /// descriptor had succeeded, back otherwise, dirty flags are cleared and
+  /// all descriptors are freed. Must run before any access to the targets.
+  /// Returns the number of descriptors that were in use.
+  static uint64_t Recovery(Descriptor* descriptors, uint32_t descriptor_count);
+
+  /// A descriptor of the calling thread's partition, or nullptr if all of
+  /// them are still retired or every partition is taken. Call from inside
+  /// the protected region. The caller's own protection keeps the
+  /// descriptors it retired since entering from expiring, so on nullptr it
+  /// must leave the protected region, let the epoch move on and retry.
+  Descriptor* AllocateDescriptor();
+
+  EpochManager* GetEpoch() { return epoch_manager_; }
+
+ private:
+  friend class Descriptor;
+
+  struct Partition {
+    /// pthread_self() of the owner, 0 while the partition is free.
+    std::atomic<uint64_t> thread_id;
+    GarbageListUnsafe garbage_list;
+    std::vector<Descriptor*> free_descriptors;
+  };
+
+  void Retire(Descriptor* descriptor);
+  Partition* GetPartitionForThread();
+  Partition* ReservePartition(uint64_t thread_id);
+  static void ReleasePartition(void* partition);
+  static void FreeDescriptor(void* partition, void* descriptor);
+
+  EpochManager* epoch_manager_;
+  Descriptor* descriptors_;
+  uint32_t descriptor_count_;
+
+  Partition* partitions_;
+  uint32_t partition_count_;
+
+  /// Identifies this pool in ThreadSlots, where the calling thread's
+  /// partition is cached.
+  uint64_t id_;
+};
+
+void Descriptor::Retire() { pool_->Retire(this); }
+
+bool DescriptorPool::Initialize(EpochManager* epoch_manager,
+                                Descriptor* descriptors,
+                                uint32_t descriptor_count,
+                                uint32_t partition_count) {
+  if (partitions_) return true;
+  if (!epoch_manager || !descriptors || !partition_count ||
+      descriptor_count < partition_count) {
+    return false;
+  }
+
+  // Descriptors never leave the partition they are handed to, so a ring
+  // that holds all of them never fills up with unreclaimable ones.
+  uint32_t per_partition =
+      (descriptor_count + partition_count - 1) / partition_count;
+  size_t ring_size = 1;
+  while (ring_size < per_partition) ring_size <<= 1;
+
+  partitions_ = new Partition[partition_count];
+  for (uint32_t i = 0; i < partition_count; ++i) {
+    partitions_[i].thread_id = 0;
+    partitions_[i].garbage_list.Initialize(epoch_manager, ring_size);
+  }
+  for (uint32_t i = 0; i < descriptor_count; ++i) {
+    Descriptor& descriptor = descriptors[i];
+    memset(&descriptor, 0, sizeof(Descriptor));
+    descriptor.pool_ = this;
+    descriptor.Persist();
+    partitions_[i % partition_count].free_descriptors.push_back(&descriptor);
+  }
+
+  descriptors_ = descriptors;
+  descriptor_count_ = descriptor_count;
+  partition_count_ = partition_count;
+  id_ = ThreadSlots::AcquireOwner();
+  epoch_manager_ = epoch_manager;
+  return true;
+}
+
+bool DescriptorPool::Uninitialize() {
+  if (!partitions_) return true;
+
+  ThreadSlots::ReleaseOwner(id_);
+  // Threads that have not exited yet must not call back into freed
+  // partitions.
+  Thread::UnregisterTlsInRange(partitions_, partitions_ + partition_count_);
+  for (uint32_t i = 0; i < partition_count_; ++i) {
+    partitions_[i].garbage_list.Uninitialize();
+  }
+  delete[] partitions_;
+
+  partitions_ = nullptr;
+  partition_count_ = 0;
+  descriptors_ = nullptr;
+  descriptor_count_ = 0;
+  epoch_manager_ = nullptr;
+  return true;
+}
+
+uint64_t DescriptorPool::Recovery(Descriptor* descriptors,
+                                  uint32_t descriptor_count) {
+  uint64_t recovered = 0;
+  for (uint32_t i = 0; i < descriptor_count; ++i) {
+    Descriptor& descriptor = descriptors[i];
+    uint64_t status = descriptor.status_ & ~Descriptor::kDirtyFlag;
+    if (status == Descriptor::kStatusFree) continue;
+
+    // Undecided counts as failed: no word was changed for good yet.
+    bool succeeded = status == Descriptor::kStatusSucceeded;
+    uint64_t me = reinterpret_cast<uint64_t>(&descriptor) |
+                  Descriptor::kMwCASFlag;
+    uint32_t count = std::min(descriptor.count_, Descriptor::kMaxWords);
+    for (uint32_t j = 0; j < count; ++j) {
+      WordDescriptor& word = descriptor.words_[j];
+      if (!word.address_) continue;
+      uint64_t value = *word.address_ & ~Descriptor::kDirtyFlag;
+      if (value == me) {
+        value = succeeded ? word.new_ : word.old_;
+      } else if (value == (reinterpret_cast<uint64_t>(&word) |
+                           Descriptor::kRDCSSFlag)) {
+        value = word.old_;
+      }
+      // Whatever else it holds made it to persistent memory.
+      *word.address_ = value;
+      flush(word.address_);
+    }
+    memset(&descriptor, 0, sizeof(Descriptor));
+    descriptor.Persist();
+    recovered += 1;
+  }
+  fence();
+  return recovered;
+}
+
+Descriptor* DescriptorPool::AllocateDescriptor() {
+  Partition* partition = GetPartitionForThread();
+  if (!partition) return nullptr;
+
+  auto& free_descriptors = partition->free_descriptors;
+  if (free_descriptors.empty()) partition->garbage_list.Scavenge();
+  if (free_descriptors.empty()) return nullptr;
+
+  Descriptor* descriptor = free_descriptors.back();
+  free_descriptors.pop_back();
+  descriptor->partition_ = partition;
+  descriptor->count_ = 0;
+  descriptor->status_ = Descriptor::kStatusUndecided;
+  return descriptor;
+}
+
+void DescriptorPool::Retire(Descriptor* descriptor) {
+  auto* partition = reinterpret_cast<Partition*>(descriptor->partition_);
+  partition->garbage_list.Push(descriptor, &DescriptorPool::FreeDescriptor,
+                               partition);
+}
+
+/// Reclaim callback of the partitions' garbage lists: nobody can be helping
+/// \a descriptor any more, free it.
+void DescriptorPool::FreeDescriptor(void* partition, void* descriptor) {
+  auto* free_descriptor = reinterpret_cast<Descriptor*>(descriptor);
+  free_descriptor->status_ = Descriptor::kStatusFree;
+  free_descriptor->count_ = 0;
+  flush(&free_descriptor->status_);
+  fence();
+  reinterpret_cast<Partition*>(partition)->free_descriptors.push_back(
+      free_descriptor);
+}
+
+/// Returns the calling thread's partition: cached in TLS, else the one it
+/// holds, else a free one. nullptr if every partition is taken.
+DescriptorPool::Partition* DescriptorPool::GetPartitionForThread() {
+  ThreadSlots::Slot* slot = ThreadSlots::Find(id_);
+  if (slot) return reinterpret_cast<Partition*>(slot->value);
+  slot = ThreadSlots::Claim(id_);
+
+  uint64_t thread_id = pthread_self();
+  if (!slot) {
+    // This thread uses more pools than it can cache.
+    for (uint32_t i = 0; i < partition_count_; ++i) {
+      if (partitions_[i].thread_id.load(std::memory_order_relaxed) ==
+          thread_id) {
+        return &partitions_[i];
+      }
+    }
+  }
+
+  Partition* partition = ReservePartition(thread_id);
+  if (!partition) {
+    if (slot) *slot = ThreadSlots::Slot{};
+    return nullptr;
+  }
+
+  uint64_t* tls = nullptr;
+  if (slot) {
+    slot->value = reinterpret_cast<uint64_t>(partition);
+    tls = &slot->owner;
+  }
+  Thread::RegisterTls(tls, 0, &DescriptorPool::ReleasePartition, partition);
+  return partition;
+}
+
+/// Claim a free partition for \a thread_id, probing from its hash.
+DescriptorPool::Partition* DescriptorPool::ReservePartition(
+    uint64_t thread_id) {
+  uint64_t start = Murmur3_64(thread_id);
+  for (uint32_t i = 0; i < partition_count_; ++i) {
+    Partition& partition = partitions_[(start + i) % partition_count_];
+    uint64_t expected = 0;
+    if (partition.thread_id.load(std::memory_order_relaxed) == 0 &&
+        partition.thread_id.compare_exchange_strong(
+            expected, thread_id, std::memory_order_acquire)) {
+      return &partition;
+    }
+  }
+  return nullptr;
+}
+
+/// Thread exit callback: leave the partition, with its retired descriptors,
+/// for the next thread.
+void DescriptorPool::ReleasePartition(void* partition) {
+  reinterpret_cast<Partition*>(partition)->thread_id.store(
+      0, std::memory_order_release);
+}
+
+}  // namespace very_pm
@@ -0,0 +1,96 @@
+#include "../epoch_arena.h"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+class EpochArenaTest : public ::testing::Test {
+ public:
+  EpochArenaTest() {}
+
+ protected:
+  EpochManager epoch_manager_;
+  GarbageList garbage_list_;
+  EpochArena arena_;
+
+  virtual void SetUp() {
+    ASSERT_TRUE(epoch_manager_.Initialize());
+    ASSERT_TRUE(garbage_list_.Initialize(&epoch_manager_, 1024));
+    ASSERT_TRUE(arena_.Initialize(&garbage_list_, 4096));
+  }
+
+  virtual void TearDown() {
+    arena_.Seal();
+    EXPECT_TRUE(garbage_list_.Uninitialize());
+    EXPECT_TRUE(epoch_manager_.Uninitialize());
+    Thread::ClearRegistry(true);
+  }
+};
+
+TEST_F(EpochArenaTest, Allocate) {
+  EXPECT_EQ(nullptr, arena_.Allocate(4096));
+  uint64_t* first = reinterpret_cast<uint64_t*>(arena_.Allocate(8, 64));
+  ASSERT_NE(nullptr, first);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(first) & 63);
+  *first = 42;
+  // Spans several blocks.
+  for (int i = 0; i < 1000; ++i) {
+    uint64_t* object = reinterpret_cast<uint64_t*>(arena_.Allocate(8));
+    ASSERT_NE(nullptr, object);
+    *object = i;
+  }
+  EXPECT_EQ(42u, *first);
+  EXPECT_EQ(1001u, arena_.GetAllocatedCount());
+  arena_.RetireAll();
+}
+
+TEST_F(EpochArenaTest, RejectObjectsThatFitNoBlock) {
+  EXPECT_EQ(nullptr, arena_.Allocate(0));
+  char* first = reinterpret_cast<char*>(arena_.Allocate(8));
+  ASSERT_NE(nullptr, first);
+
+  // Neither opens a block, so the next object still lands in the first one.
+  EXPECT_EQ(nullptr, arena_.Allocate(4096));
+  EXPECT_EQ(nullptr, arena_.Allocate(8, 4096));
+  char* second = reinterpret_cast<char*>(arena_.Allocate(8));
+  ASSERT_NE(nullptr, second);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(first) & ~4095ull,
+            reinterpret_cast<uintptr_t>(second) & ~4095ull);
+  EXPECT_EQ(2u, arena_.GetAllocatedCount());
+  arena_.RetireAll();
+}
+
+TEST_F(EpochArenaTest, ReleaseGenerationOnLastRetire) {
+  std::vector<void*> objects;
+  for (int i = 0; i < 1000; ++i) objects.push_back(arena_.Allocate(16));
+  for (size_t i = 0; i < objects.size() - 1; ++i) arena_.Retire(objects[i]);
+  arena_.Seal();
+
+  // One object is still live: nothing is pushed yet.
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(0, garbage_list_.Scavenge());
+
+  // The last retire pushes the whole generation as a single item.
+  EpochArena::Retire(objects.back(), 4096);
+  EXPECT_EQ(0, garbage_list_.Scavenge());
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(1, garbage_list_.Scavenge());
+}
+
+TEST_F(EpochArenaTest, RetireAll) {
+  for (int i = 0; i < 1000; ++i) ASSERT_NE(nullptr, arena_.Allocate(32));
+  arena_.RetireAll();
+  EXPECT_EQ(0u, arena_.GetAllocatedCount());
+
+  // The arena opens a new generation on the next allocation.
+  EXPECT_NE(nullptr, arena_.Allocate(32));
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(1, garbage_list_.Scavenge());
+  arena_.RetireAll();
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
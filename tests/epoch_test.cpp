@@ -77,12 +77,221 @@ TEST_F(EpochManagerTest, Unprotect) {
   EXPECT_TRUE(mgr_.Unprotect());
 }
 
+TEST_F(EpochManagerTest, MultipleManagers) {
+  EpochManager other;
+  ASSERT_TRUE(other.Initialize());
+  EXPECT_TRUE(mgr_.Protect());
+  EXPECT_FALSE(other.IsProtected());
+  EXPECT_TRUE(other.Protect());
+  EXPECT_TRUE(other.Unprotect());
+  // Leaving the other manager's region leaves ours alone.
+  EXPECT_TRUE(mgr_.IsProtected());
+  EXPECT_FALSE(other.IsProtected());
+  EXPECT_TRUE(mgr_.Unprotect());
+  EXPECT_TRUE(other.Uninitialize());
+}
+
+TEST_F(EpochManagerTest, ThreadContext) {
+  mgr_.BumpCurrentEpoch();
+  EpochManager::ThreadContext context(&mgr_);
+  EXPECT_EQ(&mgr_, context.GetEpochManager());
+  EXPECT_TRUE(context.Protect());
+  EXPECT_TRUE(context.IsProtected());
+  // The context shares the thread's entry with the plain API.
+  EXPECT_TRUE(mgr_.IsProtected());
+  mgr_.BumpCurrentEpoch();
+  EXPECT_EQ(1llu, mgr_.safe_to_reclaim_epoch_.load());
+  EXPECT_TRUE(context.Unprotect());
+  EXPECT_FALSE(mgr_.IsProtected());
+  mgr_.BumpCurrentEpoch();
+  EXPECT_EQ(2llu, mgr_.safe_to_reclaim_epoch_.load());
+}
+
+TEST_F(EpochManagerTest, AsymmetricFence) {
+  EpochManager mgr;
+  ASSERT_TRUE(mgr.Initialize(EpochManager::kAsymmetricFence));
+  LOG_IF(INFO, !mgr.epoch_table_->IsAsymmetricFence())
+      << "expedited membarrier unavailable, testing the fallback";
+  mgr.BumpCurrentEpoch();
+  {
+    EpochGuard guard(&mgr);
+    EXPECT_TRUE(mgr.IsProtected());
+    mgr.BumpCurrentEpoch();
+    EXPECT_EQ(1llu, mgr.safe_to_reclaim_epoch_.load());
+  }
+  EXPECT_FALSE(mgr.IsProtected());
+  mgr.BumpCurrentEpoch();
+  EXPECT_EQ(2llu, mgr.safe_to_reclaim_epoch_.load());
+  EXPECT_TRUE(mgr.Uninitialize());
+}
+
+TEST_F(EpochManagerTest, PerCpu) {
+  EpochManager mgr;
+  ASSERT_TRUE(mgr.Initialize(EpochManager::kPerCpu));
+  ASSERT_NE(nullptr, mgr.per_cpu_table_);
+  mgr.BumpCurrentEpoch();
+  EXPECT_EQ(2llu, mgr.GetCurrentEpoch());
+  EXPECT_EQ(0llu, mgr.safe_to_reclaim_epoch_.load());
+
+  {
+    EpochGuard guard(&mgr);
+    EXPECT_TRUE(mgr.IsProtected());
+    // Nobody is left in epoch 1: move to 3, epoch 1 is safe.
+    mgr.BumpCurrentEpoch();
+    EXPECT_EQ(3llu, mgr.GetCurrentEpoch());
+    EXPECT_EQ(1llu, mgr.safe_to_reclaim_epoch_.load());
+    // This thread still reads in epoch 2, which holds the epoch back.
+    mgr.BumpCurrentEpoch();
+    EXPECT_EQ(3llu, mgr.GetCurrentEpoch());
+    EXPECT_EQ(1llu, mgr.safe_to_reclaim_epoch_.load());
+  }
+  EXPECT_FALSE(mgr.IsProtected());
+  mgr.BumpCurrentEpoch();
+  EXPECT_EQ(4llu, mgr.GetCurrentEpoch());
+  EXPECT_EQ(2llu, mgr.safe_to_reclaim_epoch_.load());
+
+  // A reader leaving from another thread (as after a migration) still
+  // balances the counters.
+  EpochManager::ThreadContext context(&mgr);
+  EXPECT_TRUE(context.Protect());
+  EXPECT_TRUE(context.IsProtected());
+  // The context shares the thread's bucket with the plain API.
+  EXPECT_TRUE(mgr.IsProtected());
+  EXPECT_TRUE(mgr.Unprotect());
+  EXPECT_FALSE(context.IsProtected());
+  EXPECT_FALSE(context.Unprotect());
+  EXPECT_TRUE(mgr.Protect());
+  EXPECT_TRUE(context.IsProtected());
+  Thread worker([&mgr]() {
+    for (int i = 0; i < 1000; ++i) {
+      EpochGuard guard(&mgr);
+    }
+  });
+  worker.join();
+  mgr.BumpCurrentEpoch();
+  mgr.BumpCurrentEpoch();
+  EXPECT_EQ(5llu, mgr.GetCurrentEpoch());
+  EXPECT_TRUE(context.Unprotect());
+  mgr.BumpCurrentEpoch();
+  EXPECT_EQ(6llu, mgr.GetCurrentEpoch());
+  EXPECT_EQ(4llu, mgr.safe_to_reclaim_epoch_.load());
+  EXPECT_TRUE(mgr.Uninitialize());
+}
+
+TEST_F(EpochManagerTest, QuiescentState) {
+  EpochManager mgr;
+  EXPECT_FALSE(
+      mgr.Initialize(EpochManager::kQuiescentState | EpochManager::kPerCpu));
+  ASSERT_TRUE(mgr.Initialize(EpochManager::kQuiescentState));
+
+  // Coming online is sticky, Unprotect() does not take the thread offline.
+  EXPECT_TRUE(mgr.Protect());
+  EXPECT_TRUE(mgr.Unprotect());
+  EXPECT_TRUE(mgr.IsProtected());
+  mgr.BumpCurrentEpoch();
+  mgr.BumpCurrentEpoch();
+  EXPECT_EQ(0llu, mgr.safe_to_reclaim_epoch_.load());
+
+  // Announcing a quiescent state lets the reclaimer catch up.
+  EXPECT_TRUE(mgr.QuiescentState());
+  mgr.BumpCurrentEpoch();
+  EXPECT_EQ(2llu, mgr.safe_to_reclaim_epoch_.load());
+
+  EpochManager::ThreadContext context(&mgr);
+  EXPECT_TRUE(context.Protect());
+  EXPECT_TRUE(context.Unprotect());
+  EXPECT_TRUE(context.QuiescentState());
+  mgr.BumpCurrentEpoch();
+  EXPECT_EQ(3llu, mgr.safe_to_reclaim_epoch_.load());
+
+  // An offline thread holds nothing back.
+  EXPECT_TRUE(context.ThreadOffline());
+  EXPECT_FALSE(mgr.IsProtected());
+  mgr.BumpCurrentEpoch();
+  EXPECT_EQ(mgr.GetCurrentEpoch() - 2, mgr.safe_to_reclaim_epoch_.load());
+  EXPECT_TRUE(mgr.Uninitialize());
+}
+
 TEST_F(EpochManagerTest, BumpCurrentEpoch) {
   EXPECT_EQ(1llu, mgr_.GetCurrentEpoch());
   mgr_.BumpCurrentEpoch();
   EXPECT_EQ(2llu, mgr_.GetCurrentEpoch());
 }
 
+TEST_F(EpochManagerTest, EpochAdvancer) {
+  auto wait_for_epoch = [this](Epoch epoch) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (mgr_.GetCurrentEpoch() < epoch &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return mgr_.GetCurrentEpoch() >= epoch;
+  };
+
+  // Time based: the epoch keeps moving without anybody asking.
+  EXPECT_TRUE(mgr_.StartEpochAdvancer(100));
+  EXPECT_TRUE(wait_for_epoch(4));
+  EXPECT_LE(mgr_.GetCurrentEpoch() - 2, mgr_.safe_to_reclaim_epoch_.load());
+  mgr_.StopEpochAdvancer();
+
+  // Pressure based: a request wakes the advancer long before its interval.
+  EXPECT_TRUE(mgr_.StartEpochAdvancer(60 * 1000 * 1000));
+  Epoch epoch = mgr_.GetCurrentEpoch();
+  mgr_.RequestEpochAdvance();
+  EXPECT_TRUE(wait_for_epoch(epoch + 1));
+  mgr_.StopEpochAdvancer();
+
+  // Without the advancer, requests bump inline.
+  epoch = mgr_.GetCurrentEpoch();
+  mgr_.RequestEpochAdvance();
+  EXPECT_EQ(epoch + 1, mgr_.GetCurrentEpoch());
+}
+
+TEST_F(EpochManagerTest, Synchronize) {
+  // Nobody is reading: returns right away.
+  EXPECT_TRUE(mgr_.Synchronize());
+  {
+    EpochGuard guard(&mgr_);
+    EXPECT_FALSE(mgr_.Synchronize());
+  }
+
+  std::atomic<bool> reading{false};
+  std::atomic<bool> left{false};
+  Thread reader([&]() {
+    EpochGuard guard(&mgr_);
+    reading = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    left = true;
+  });
+  while (!reading) std::this_thread::yield();
+  EXPECT_TRUE(mgr_.Synchronize());
+  EXPECT_TRUE(left);
+  reader.join();
+}
+
+TEST_F(EpochManagerTest, CallAfterGracePeriod) {
+  std::atomic<uint32_t> calls{0};
+  auto callback = [](void* context) {
+    ++*reinterpret_cast<std::atomic<uint32_t>*>(context);
+  };
+
+  mgr_.Protect();
+  EXPECT_TRUE(mgr_.CallAfterGracePeriod(callback, &calls));
+  mgr_.BumpCurrentEpoch();
+  mgr_.BumpCurrentEpoch();
+  EXPECT_EQ(0u, calls.load());
+  mgr_.Unprotect();
+  mgr_.BumpCurrentEpoch();
+  EXPECT_EQ(1u, calls.load());
+
+  // Still pending callbacks run on Uninitialize().
+  mgr_.Protect();
+  EXPECT_TRUE(mgr_.CallAfterGracePeriod(callback, &calls));
+  mgr_.Unprotect();
+  EXPECT_TRUE(mgr_.Uninitialize());
+  EXPECT_EQ(2u, calls.load());
+}
+
 TEST_F(EpochManagerTest, ComputeNewSafeToReclaimEpoch) {
   mgr_.epoch_table_->table_[0].protected_epoch = 98;
   mgr_.current_epoch_ = 99;
@@ -263,6 +472,123 @@ TEST_F(MinEpochTableTest, reserveEntry) {
   EXPECT_EQ(4u, table_.table_[2].thread_id.load());
 }
 
+TEST_F(MinEpochTableTest, GrowWhenFull) {
+  for (uint64_t i = 0; i < table_.size_; ++i) table_.ReserveEntry(i, 1);
+  EXPECT_EQ(nullptr, table_.segments_.load());
+
+  MinEpochTable::Entry* entry = nullptr;
+  EXPECT_TRUE(table_.GetEntryForThread(&entry));
+  auto* segment = table_.segments_.load();
+  ASSERT_NE(nullptr, segment);
+  EXPECT_EQ(table_.size_ * 2, segment->size);
+  EXPECT_GE(entry, segment->table);
+  EXPECT_LT(entry, segment->table + segment->size);
+  EXPECT_EQ(pthread_self(), entry->thread_id.load());
+
+  // Protected entries in the chained segment must hold back reclamation.
+  EXPECT_TRUE(table_.Protect(42));
+  EXPECT_EQ(41llu, table_.ComputeNewSafeToReclaimEpoch(100));
+  EXPECT_TRUE(table_.Unprotect(43));
+  EXPECT_EQ(99llu, table_.ComputeNewSafeToReclaimEpoch(100));
+}
+
+TEST_F(MinEpochTableTest, ReleaseEntryOnThreadExit) {
+  for (int round = 0; round < 4; ++round) {
+    Thread worker([this]() {
+      EXPECT_TRUE(table_.Protect(99));
+      EXPECT_TRUE(table_.Unprotect(100));
+    });
+    worker.join();
+  }
+  // Every exited thread handed its entry back.
+  for (uint64_t i = 0; i < table_.size_; ++i) {
+    EXPECT_EQ(0lu, table_.table_[i].thread_id.load());
+    EXPECT_EQ(0llu, table_.table_[i].last_unprotected_epoch);
+  }
+  EXPECT_EQ(nullptr, table_.segments_.load());
+
+  MinEpochTable::Entry* entry = nullptr;
+  EXPECT_TRUE(table_.GetEntryForThread(&entry));
+  table_.ReleaseEntryForThread();
+  EXPECT_EQ(0lu, entry->thread_id.load());
+}
+
+TEST_F(MinEpochTableTest, PackedScan) {
+  EXPECT_TRUE(table_.Uninitialize());
+  EXPECT_TRUE(
+      table_.Initialize(MinEpochTable::kDefaultSize, EpochManager::kPackedScan));
+  ASSERT_NE(nullptr, table_.packed_table_);
+  EXPECT_EQ(99llu, table_.ComputeNewSafeToReclaimEpoch(100));
+
+  // Protect()/Unprotect() keep the mirror in sync.
+  EXPECT_TRUE(table_.Protect(42));
+  EXPECT_EQ(41llu, table_.ComputeNewSafeToReclaimEpoch(100));
+  EXPECT_TRUE(table_.Unprotect(43));
+  EXPECT_EQ(99llu, table_.ComputeNewSafeToReclaimEpoch(100));
+
+  // Grow the table so the scan has to walk a segment as well.
+  for (uint64_t i = 0; i < table_.size_ * 2; ++i) table_.ReserveEntry(i, 1);
+  auto* segment = table_.segments_.load();
+  ASSERT_NE(nullptr, segment);
+  ASSERT_NE(nullptr, segment->packed);
+
+  std::random_device rd;
+  std::default_random_engine engine(rd());
+  std::uniform_int_distribution<Epoch> dist(2, 1000);
+  Epoch expected = 1001;
+  auto fill = [&](MinEpochTable::Entry* entries, uint64_t size) {
+    for (uint64_t i = 0; i < size; ++i) {
+      // Leave some entries unprotected.
+      Epoch epoch = i % 3 ? dist(engine) : 0;
+      entries[i].packed_epoch->store(epoch);
+      if (epoch != 0 && epoch < expected) expected = epoch;
+    }
+  };
+  fill(table_.table_, table_.size_);
+  fill(segment->table, segment->size);
+  EXPECT_EQ(expected - 1, table_.ComputeNewSafeToReclaimEpoch(1001));
+
+  segment->table[segment->size - 1].packed_epoch->store(expected - 1);
+  EXPECT_EQ(expected - 2, table_.ComputeNewSafeToReclaimEpoch(1001));
+}
+
+TEST_F(MinEpochTableTest, ThreadSlotOverflow) {
+  std::vector<std::unique_ptr<MinEpochTable>> tables;
+  for (uint32_t i = 0; i < MinEpochTable::kThreadSlots + 2; ++i) {
+    tables.emplace_back(new MinEpochTable());
+    ASSERT_TRUE(tables.back()->Initialize());
+  }
+  for (auto& table : tables) {
+    MinEpochTable::Entry* first = nullptr;
+    MinEpochTable::Entry* second = nullptr;
+    EXPECT_TRUE(table->GetEntryForThread(&first));
+    EXPECT_TRUE(table->GetEntryForThread(&second));
+    EXPECT_EQ(first, second);
+    uint64_t owned = 0;
+    for (uint64_t i = 0; i < table->size_; ++i) {
+      owned += table->table_[i].thread_id == pthread_self();
+    }
+    EXPECT_EQ(1llu, owned);
+  }
+  for (auto& table : tables) {
+    table->ReleaseEntryForThread();
+    EXPECT_TRUE(table->Uninitialize());
+  }
+}
+
+TEST_F(MinEpochTableTest, ReclaimStaleThreadSlots) {
+  // Tables torn down by another thread leave this thread's slots behind;
+  // they must not keep it from caching its entry in the next ones.
+  for (uint32_t i = 0; i < 2 * MinEpochTable::kThreadSlots; ++i) {
+    MinEpochTable table;
+    ASSERT_TRUE(table.Initialize());
+    MinEpochTable::Entry* entry = nullptr;
+    EXPECT_TRUE(table.GetEntryForThread(&entry));
+    EXPECT_NE(nullptr, ThreadSlots::Find(table.id_));
+    std::thread([&table]() { EXPECT_TRUE(table.Uninitialize()); }).join();
+  }
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -74,6 +74,17 @@ TEST_F(GarbageListPMTest, Recovery) {
   EXPECT_EQ(1, items[1].deallocations);
 }
 
+TEST_F(GarbageListPMTest, ParallelRecovery) {
+  std::vector<MockItem> items(1000);
+  for (auto& item : items) {
+    EXPECT_TRUE(garbage_list_.Push(&item, MockItem::Destroy, nullptr));
+  }
+  GarbageList::RecoveryStats stats{};
+  EXPECT_TRUE(garbage_list_.Recovery(&epoch_manager_, pool_, 4, &stats));
+  EXPECT_EQ(1000u, stats.reclaimed);
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+}
+
 TEST_F(GarbageListPMTest, ReserveMemory) {
   const uint64_t test_items = 20;
   std::vector<GarbageList::Item*> reserved_vec(test_items);
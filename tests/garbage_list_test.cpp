@@ -1,6 +1,7 @@
 #include "../garbage_list.h"
 #include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <set>
 #include "../garbage_list_unsafe.h"
 
 struct MockItem {
@@ -46,6 +47,397 @@ TEST_F(GarbageListTest, Uninitialize) {
   EXPECT_EQ(1, items[1].deallocations);
 }
 
+TEST_F(GarbageListTest, PushBatch) {
+  // Larger than a quarter of the ring, so it is claimed in several chunks.
+  std::vector<MockItem> items(600);
+  std::vector<GarbageList::BatchItem> batch;
+  for (auto& item : items) {
+    batch.push_back(GarbageList::BatchItem{&item, MockItem::Destroy, nullptr});
+  }
+  EXPECT_TRUE(garbage_list_.PushBatch(batch.data(), batch.size()));
+  for (auto& item : items) EXPECT_EQ(0, item.deallocations);
+
+  // Wrapping around reclaims the batch like single pushes would.
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  MockItem more[1024];
+  for (auto& item : more) {
+    EXPECT_TRUE(garbage_list_.Push(&item, MockItem::Destroy, nullptr));
+  }
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+  EXPECT_TRUE(garbage_list_.Uninitialize());
+}
+
+TEST_F(GarbageListTest, Reclaimer) {
+  ASSERT_TRUE(garbage_list_.StartReclaimer(16));
+  std::vector<MockItem> items(100);
+  epoch_manager_.Protect();
+  for (auto& item : items) {
+    EXPECT_TRUE(garbage_list_.Push(&item, MockItem::Destroy, nullptr));
+  }
+  EXPECT_EQ(0u, garbage_list_.GetReclaimerStats().reclaimed);
+  epoch_manager_.Unprotect();
+
+  // The reclaimer nudges the epoch itself and drains the ring.
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (garbage_list_.GetReclaimerStats().reclaimed < items.size() &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto stats = garbage_list_.GetReclaimerStats();
+  EXPECT_EQ(items.size(), stats.reclaimed);
+  EXPECT_EQ(0u, stats.queue_depth);
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+  garbage_list_.StopReclaimer();
+}
+
+TEST_F(GarbageListTest, Scavenge) {
+  MockItem items[10];
+  epoch_manager_.Protect();
+  for (auto& item : items) {
+    EXPECT_TRUE(garbage_list_.Push(&item, MockItem::Destroy, nullptr));
+  }
+  EXPECT_EQ(0, garbage_list_.Scavenge());
+  epoch_manager_.Unprotect();
+
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(10, garbage_list_.Scavenge());
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+  EXPECT_EQ(0, garbage_list_.Scavenge());
+
+  MockItem more[3];
+  for (auto& item : more) {
+    EXPECT_TRUE(garbage_list_.Push(&item, MockItem::Destroy, nullptr));
+  }
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(3, garbage_list_.Scavenge());
+}
+
+TEST_F(GarbageListTest, ScavengePastReservedItem) {
+  MockItem items[10];
+  EXPECT_TRUE(garbage_list_.Push(&items[0], MockItem::Destroy, nullptr));
+  auto* reserved = garbage_list_.ReserveItem();
+  for (int i = 1; i < 10; ++i) {
+    EXPECT_TRUE(garbage_list_.Push(&items[i], MockItem::Destroy, nullptr));
+  }
+
+  // An outstanding reservation does not hold back the items after it.
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(10, garbage_list_.Scavenge());
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+
+  MockItem more[3];
+  for (auto& item : more) {
+    EXPECT_TRUE(garbage_list_.Push(&item, MockItem::Destroy, nullptr));
+  }
+  EXPECT_TRUE(garbage_list_.ResetItem(reserved));
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(3, garbage_list_.Scavenge());
+  EXPECT_EQ(0, garbage_list_.Scavenge());
+}
+
+TEST_F(GarbageListTest, ScavengeSlowPusher) {
+  MockItem items[3];
+  EXPECT_TRUE(garbage_list_.Push(&items[0], MockItem::Destroy, nullptr));
+  // A pusher took a position but has not claimed its slot yet.
+  int64_t position = garbage_list_.tail_.fetch_add(1) - 1;
+  EXPECT_TRUE(garbage_list_.Push(&items[1], MockItem::Destroy, nullptr));
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(2, garbage_list_.Scavenge());
+
+  // Its item is not stepped over once it lands.
+  auto& slot = garbage_list_.items_[position & (1024 - 1)];
+  slot.destroy_callback = MockItem::Destroy;
+  slot.destroy_callback_context = nullptr;
+  slot.removed_item = &items[2];
+  slot.removal_epoch = epoch_manager_.GetCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(1, garbage_list_.Scavenge());
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+}
+
+TEST_F(GarbageListTest, Overflow) {
+  GarbageList garbage_list;
+  ASSERT_TRUE(garbage_list.Initialize(&epoch_manager_, 16,
+                                      GarbageList::OverflowPolicy::kOverflow));
+  MockItem items[20];
+  epoch_manager_.Protect();
+  for (auto& item : items) {
+    EXPECT_TRUE(garbage_list.Push(&item, MockItem::Destroy, nullptr));
+  }
+  auto stats = garbage_list.GetOverflowStats();
+  EXPECT_EQ(1u, stats.full_laps);
+  EXPECT_EQ(4u, stats.overflowed);
+  EXPECT_EQ(4u, stats.overflow_depth);
+  epoch_manager_.Unprotect();
+
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(20, garbage_list.Scavenge());
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+  EXPECT_EQ(0u, garbage_list.GetOverflowStats().overflow_depth);
+}
+
+TEST_F(GarbageListTest, FailWhenFull) {
+  GarbageList garbage_list;
+  ASSERT_TRUE(garbage_list.Initialize(&epoch_manager_, 16,
+                                      GarbageList::OverflowPolicy::kFail));
+  MockItem items[17];
+  epoch_manager_.Protect();
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_TRUE(garbage_list.Push(&items[i], MockItem::Destroy, nullptr));
+  }
+  EXPECT_FALSE(garbage_list.Push(&items[16], MockItem::Destroy, nullptr));
+  EXPECT_EQ(1u, garbage_list.GetOverflowStats().failed);
+  epoch_manager_.Unprotect();
+  EXPECT_TRUE(garbage_list.Uninitialize());
+  EXPECT_EQ(0, items[16].deallocations);
+}
+
+TEST_F(GarbageListTest, BlockWhenFull) {
+  GarbageList garbage_list;
+  ASSERT_TRUE(garbage_list.Initialize(&epoch_manager_, 16,
+                                      GarbageList::OverflowPolicy::kBlock));
+  MockItem items[17];
+  std::atomic<bool> reader_protected{false};
+  std::atomic<bool> release{false};
+  Thread reader([&]() {
+    epoch_manager_.Protect();
+    reader_protected = true;
+    while (!release) std::this_thread::yield();
+    epoch_manager_.Unprotect();
+  });
+  while (!reader_protected) std::this_thread::yield();
+
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_TRUE(garbage_list.Push(&items[i], MockItem::Destroy, nullptr));
+  }
+  Thread unblocker([&]() {
+    while (!garbage_list.GetOverflowStats().blocked) {
+      std::this_thread::yield();
+    }
+    release = true;
+  });
+  EXPECT_TRUE(garbage_list.Push(&items[16], MockItem::Destroy, nullptr));
+  EXPECT_LE(1u, garbage_list.GetOverflowStats().blocked);
+  unblocker.join();
+  reader.join();
+}
+
+TEST_F(GarbageListTest, ByteThresholds) {
+  ASSERT_TRUE(garbage_list_.SetByteThresholds(0, 4096));
+  MockItem items[8];
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(garbage_list_.PushWithSize(&items[i], 1024, MockItem::Destroy,
+                                           nullptr));
+  }
+  EXPECT_EQ(4096u, garbage_list_.GetRetiredBytes());
+  EXPECT_EQ(0u, garbage_list_.GetOverflowStats().throttled);
+
+  // Over the cap: the push waits for the epoch to reclaim the first items.
+  EXPECT_TRUE(garbage_list_.PushWithSize(&items[4], 1024, MockItem::Destroy,
+                                         nullptr));
+  EXPECT_EQ(1u, garbage_list_.GetOverflowStats().throttled);
+  EXPECT_EQ(1024u, garbage_list_.GetRetiredBytes());
+  for (int i = 0; i < 4; ++i) EXPECT_EQ(1, items[i].deallocations);
+
+  // Crossing the advance threshold rolls the epoch over and scavenges.
+  ASSERT_TRUE(garbage_list_.SetByteThresholds(2048, 0));
+  Epoch epoch = epoch_manager_.GetCurrentEpoch();
+  for (int i = 5; i < 8; ++i) {
+    EXPECT_TRUE(garbage_list_.PushWithSize(&items[i], 1024, MockItem::Destroy,
+                                           nullptr));
+  }
+  EXPECT_LT(epoch, epoch_manager_.GetCurrentEpoch());
+  EXPECT_TRUE(garbage_list_.Uninitialize());
+}
+
+TEST_F(GarbageListTest, ItemLargerThanByteCap) {
+  ASSERT_TRUE(garbage_list_.SetByteThresholds(0, 4096));
+  MockItem items[2];
+  EXPECT_TRUE(garbage_list_.PushWithSize(&items[0], 1024, MockItem::Destroy,
+                                         nullptr));
+
+  // Never fits under the cap: goes through once the list is drained.
+  EXPECT_TRUE(garbage_list_.PushWithSize(&items[1], 8192, MockItem::Destroy,
+                                         nullptr));
+  EXPECT_EQ(1, items[0].deallocations);
+  EXPECT_EQ(8192u, garbage_list_.GetRetiredBytes());
+  EXPECT_TRUE(garbage_list_.Uninitialize());
+}
+
+TEST_F(GarbageListTest, Recycle) {
+  uint32_t recycler = 0;
+  ASSERT_TRUE(
+      garbage_list_.RegisterRecycler(MockItem::Destroy, nullptr, 4, &recycler));
+  EXPECT_EQ(nullptr, garbage_list_.Recycle(recycler));
+
+  MockItem items[8];
+  for (auto& item : items) {
+    EXPECT_TRUE(garbage_list_.Push(&item, MockItem::Destroy, nullptr));
+  }
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(8, garbage_list_.Scavenge());
+
+  // The first four expired items are kept for reuse, the rest destroyed.
+  std::set<void*> recycled;
+  while (void* object = garbage_list_.Recycle(recycler)) {
+    recycled.insert(object);
+  }
+  EXPECT_EQ(4u, recycled.size());
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(i < 4 ? 0 : 1, items[i].deallocations);
+    EXPECT_EQ(i < 4 ? 1u : 0u, recycled.count(&items[i]));
+  }
+  auto stats = garbage_list_.GetRecycleStats();
+  EXPECT_EQ(4u, stats.recycled);
+  EXPECT_EQ(4u, stats.reused);
+
+  // Objects still cached are destroyed with the list.
+  MockItem cached;
+  EXPECT_TRUE(garbage_list_.Push(&cached, MockItem::Destroy, nullptr));
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(1, garbage_list_.Scavenge());
+  EXPECT_EQ(0, cached.deallocations);
+  EXPECT_TRUE(garbage_list_.Uninitialize());
+  EXPECT_EQ(1, cached.deallocations);
+}
+
+struct BulkDestroyCounter {
+  static void Destroy(void* context, void** objects, size_t count) {
+    auto* counter = reinterpret_cast<BulkDestroyCounter*>(context);
+    counter->calls += 1;
+    for (size_t i = 0; i < count; ++i) {
+      MockItem::Destroy(nullptr, objects[i]);
+    }
+  }
+
+  uint64_t calls = 0;
+};
+
+TEST_F(GarbageListTest, BulkDestroy) {
+  ASSERT_TRUE(garbage_list_.RegisterBulkCallback(MockItem::Destroy,
+                                                  BulkDestroyCounter::Destroy));
+  BulkDestroyCounter first;
+  BulkDestroyCounter second;
+  MockItem items[100];
+  for (int i = 0; i < 100; ++i) {
+    // Interleave two contexts; each batch is split in one group per context.
+    EXPECT_TRUE(garbage_list_.Push(&items[i], MockItem::Destroy,
+                                   i % 2 ? &first : &second));
+  }
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(100, garbage_list_.Scavenge());
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+  EXPECT_EQ(2u, first.calls);
+  EXPECT_EQ(2u, second.calls);
+}
+
+TEST_F(GarbageListTest, RecoverItems) {
+  GarbageList garbage_list;
+  ASSERT_TRUE(garbage_list.Initialize(&epoch_manager_, 8192));
+  std::vector<MockItem> items(5000);
+  for (auto& item : items) {
+    EXPECT_TRUE(garbage_list.Push(&item, MockItem::Destroy, nullptr));
+  }
+  // Leave holes, so that some lines are skipped and some half full.
+  uint64_t holes = 0;
+  for (uint64_t i = 0; i < garbage_list.GetItemCount(); i += 3) {
+    auto& slot = garbage_list.items_[i];
+    if (!slot.removed_item) continue;
+    reinterpret_cast<MockItem*>(slot.removed_item)->deallocations = 1;
+    slot.removed_item = nullptr;
+    slot.removal_epoch = 0;
+    holes += 1;
+  }
+
+  auto stats = garbage_list.RecoverItems(6);
+  EXPECT_EQ(items.size() - holes, stats.reclaimed);
+  EXPECT_EQ(6u, stats.threads);
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+  EXPECT_EQ(0u, garbage_list.RecoverItems(1).reclaimed);
+}
+
+TEST_F(GarbageListTest, LazyRecovery) {
+  GarbageList garbage_list;
+  ASSERT_TRUE(garbage_list.Initialize(&epoch_manager_, 64));
+  std::vector<MockItem> leftovers(64);
+  for (auto& item : leftovers) {
+    EXPECT_TRUE(garbage_list.Push(&item, MockItem::Destroy, nullptr));
+  }
+  // Pretend the items come from a previous run, whose epochs are far ahead,
+  // and that it crashed with one slot reserved.
+  for (uint64_t i = 0; i < 64; ++i) {
+    garbage_list.items_[i].removal_epoch = 1ull << 40;
+  }
+  garbage_list.items_[7].removal_epoch = GarbageList::invalid_epoch;
+  ASSERT_TRUE(garbage_list.BeginLazyRecovery());
+  garbage_list.tail_ = 0;
+  garbage_list.reclaim_cursor_ = -1;
+
+  // Pushes reclaim the leftovers in their slots right away.
+  MockItem items[10];
+  for (auto& item : items) {
+    EXPECT_TRUE(garbage_list.Push(&item, MockItem::Destroy, nullptr));
+  }
+  EXPECT_EQ(10u, garbage_list.GetRecoveredCount());
+  EXPECT_TRUE(garbage_list.IsRecovering());
+
+  // Sweeping takes care of the rest, the reserved slot included.
+  EXPECT_EQ(54u, garbage_list.RecoverStep(64));
+  EXPECT_FALSE(garbage_list.IsRecovering());
+  EXPECT_EQ(64u, garbage_list.GetRecoveredCount());
+  for (auto& item : leftovers) EXPECT_EQ(1, item.deallocations);
+  for (auto& item : items) EXPECT_EQ(0, item.deallocations);
+
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(10, garbage_list.Scavenge());
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+}
+
+TEST_F(GarbageListTest, MmapStorageRecovery) {
+  const std::string path = "gl_mmap.data";
+  unlink(path.c_str());
+  MockItem items[10];
+  // Never destroyed, like a list that went down with the process.
+  alignas(MmapGarbageList) char crashed_mem[sizeof(MmapGarbageList)];
+  auto* crashed = new (crashed_mem) MmapGarbageList();
+  ASSERT_TRUE(crashed->Initialize(&epoch_manager_, MmapStorage{path}, 64));
+  for (auto& item : items) {
+    EXPECT_TRUE(crashed->Push(&item, MockItem::Destroy, nullptr));
+  }
+
+  // Mapping the file again keeps the ring, and recovery reclaims it.
+  MmapGarbageList recovered;
+  EXPECT_FALSE(recovered.Recovery(&epoch_manager_, MmapStorage{path}));
+  ASSERT_TRUE(recovered.Initialize(&epoch_manager_, MmapStorage{path}, 64));
+  for (auto& item : items) EXPECT_EQ(0, item.deallocations);
+  MmapGarbageList::RecoveryStats stats{};
+  EXPECT_TRUE(
+      recovered.Recovery(&epoch_manager_, MmapStorage{path}, 1, &stats));
+  EXPECT_EQ(10u, stats.reclaimed);
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+
+  // The DRAM list of the fixture lives side by side with it.
+  MockItem item;
+  EXPECT_TRUE(recovered.Push(&item, MockItem::Destroy, nullptr));
+  EXPECT_TRUE(garbage_list_.Push(&item, MockItem::Destroy, nullptr));
+  EXPECT_TRUE(recovered.Uninitialize());
+  EXPECT_TRUE(garbage_list_.Uninitialize());
+  EXPECT_EQ(2, item.deallocations);
+  unlink(path.c_str());
+}
+
 class GarbageListUnsafeTest : public ::testing::Test {
  public:
   GarbageListUnsafeTest() {}
@@ -78,6 +470,90 @@ TEST_F(GarbageListUnsafeTest, Uninitialize) {
   EXPECT_EQ(1, items[1].deallocations);
 }
 
+TEST_F(GarbageListUnsafeTest, Scavenge) {
+  MockItem items[10];
+  epoch_manager_.Protect();
+  for (auto& item : items) {
+    EXPECT_TRUE(garbage_list_.Push(&item, MockItem::Destroy, nullptr));
+  }
+  EXPECT_EQ(0, garbage_list_.Scavenge());
+  epoch_manager_.Unprotect();
+
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(10, garbage_list_.Scavenge());
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+  EXPECT_EQ(0, garbage_list_.Scavenge());
+
+  MockItem more[3];
+  for (auto& item : more) {
+    EXPECT_TRUE(garbage_list_.Push(&item, MockItem::Destroy, nullptr));
+  }
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(3, garbage_list_.Scavenge());
+}
+
+class ShardedGarbageListTest : public ::testing::Test {
+ public:
+  ShardedGarbageListTest() {}
+
+ protected:
+  EpochManager epoch_manager_;
+  ShardedGarbageList garbage_list_;
+
+  virtual void SetUp() {
+    ASSERT_TRUE(epoch_manager_.Initialize());
+    ASSERT_TRUE(garbage_list_.Initialize(&epoch_manager_, 128, 2));
+  }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(garbage_list_.Uninitialize());
+    EXPECT_TRUE(epoch_manager_.Uninitialize());
+    Thread::ClearRegistry(true);
+  }
+};
+
+TEST_F(ShardedGarbageListTest, Uninitialize) {
+  MockItem items[2];
+
+  EXPECT_EQ(2u, garbage_list_.GetShardCount());
+  EXPECT_TRUE(garbage_list_.Push(&items[0], MockItem::Destroy, nullptr));
+  EXPECT_TRUE(garbage_list_.Push(&items[1], MockItem::Destroy, nullptr));
+  EXPECT_TRUE(garbage_list_.Uninitialize());
+  EXPECT_EQ(1, items[0].deallocations);
+  EXPECT_EQ(1, items[1].deallocations);
+}
+
+TEST_F(ShardedGarbageListTest, StealFromOtherShard) {
+  // While this thread is protected nothing can be reclaimed, so once the
+  // home shard is full pushes have to land in the other one.
+  std::vector<MockItem> items(100);
+  epoch_manager_.Protect();
+  for (auto& item : items) {
+    EXPECT_TRUE(garbage_list_.Push(&item, MockItem::Destroy, nullptr));
+  }
+  for (auto& item : items) EXPECT_EQ(0, item.deallocations);
+  epoch_manager_.Unprotect();
+
+  // Scavenge() walks both shards.
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  garbage_list_.Scavenge();
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+}
+
+TEST_F(ShardedGarbageListTest, ResetItemOfOtherShard) {
+  auto* item = garbage_list_.shards_[1].ReserveItem();
+  EXPECT_EQ(ShardedGarbageList::Shard::invalid_epoch, item->removal_epoch);
+  EXPECT_TRUE(garbage_list_.ResetItem(item));
+  EXPECT_EQ(0u, item->removal_epoch);
+
+  ShardedGarbageList::Shard::Item stray{};
+  stray.removal_epoch = ShardedGarbageList::Shard::invalid_epoch;
+  EXPECT_FALSE(garbage_list_.ResetItem(&stray));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
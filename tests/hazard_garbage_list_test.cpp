@@ -0,0 +1,155 @@
+#include "../hazard_garbage_list.h"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+struct MockItem {
+ public:
+  MockItem() : deallocations{0} {}
+
+  static void Destroy(void* destroyContext, void* p) {
+    ++(reinterpret_cast<MockItem*>(p))->deallocations;
+  }
+
+  std::atomic<uint64_t> deallocations;
+};
+
+class HazardPointerGarbageListTest : public ::testing::Test {
+ public:
+  HazardPointerGarbageListTest() {}
+
+ protected:
+  HazardPointerGarbageList garbage_list_;
+
+  virtual void SetUp() { ASSERT_TRUE(garbage_list_.Initialize(nullptr, 4)); }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(garbage_list_.Uninitialize());
+    Thread::ClearRegistry(true);
+  }
+};
+
+TEST_F(HazardPointerGarbageListTest, Uninitialize) {
+  MockItem items[2];
+
+  EXPECT_TRUE(garbage_list_.Push(&items[0], MockItem::Destroy, nullptr));
+  EXPECT_TRUE(garbage_list_.Push(&items[1], MockItem::Destroy, nullptr));
+  EXPECT_TRUE(garbage_list_.Uninitialize());
+  EXPECT_EQ(1, items[0].deallocations);
+  EXPECT_EQ(1, items[1].deallocations);
+}
+
+TEST_F(HazardPointerGarbageListTest, ProtectedItemSurvivesScan) {
+  MockItem items[2];
+  std::atomic<MockItem*> source{&items[0]};
+
+  MockItem* protected_item = nullptr;
+  EXPECT_TRUE(garbage_list_.Protect(0, source, &protected_item));
+  EXPECT_EQ(&items[0], protected_item);
+
+  source = &items[1];
+  EXPECT_TRUE(garbage_list_.Push(&items[0], MockItem::Destroy, nullptr));
+  EXPECT_EQ(0, garbage_list_.Scavenge());
+  EXPECT_EQ(0, items[0].deallocations);
+
+  EXPECT_TRUE(garbage_list_.Clear(0));
+  EXPECT_EQ(1, garbage_list_.Scavenge());
+  EXPECT_EQ(1, items[0].deallocations);
+  EXPECT_EQ(0, items[1].deallocations);
+}
+
+TEST_F(HazardPointerGarbageListTest, BoundedWithStalledReader) {
+  const uint64_t kItemCount = 1000;
+  std::vector<MockItem> items(kItemCount);
+  std::atomic<MockItem*> source{&items[0]};
+  std::atomic<bool> protected_item_ready{false};
+  std::atomic<bool> done{false};
+
+  // A reader that never lets go only pins the one item it protects.
+  Thread reader([&]() {
+    MockItem* protected_item = nullptr;
+    EXPECT_TRUE(garbage_list_.Protect(0, source, &protected_item));
+    protected_item_ready = true;
+    while (!done) std::this_thread::yield();
+  });
+  while (!protected_item_ready) std::this_thread::yield();
+
+  for (uint64_t i = 0; i < kItemCount; ++i) {
+    EXPECT_TRUE(garbage_list_.Push(&items[i], MockItem::Destroy, nullptr));
+  }
+  garbage_list_.Scavenge();
+  EXPECT_EQ(0, items[0].deallocations);
+  for (uint64_t i = 1; i < kItemCount; ++i) {
+    EXPECT_EQ(1, items[i].deallocations);
+  }
+
+  done = true;
+  reader.join();
+  EXPECT_EQ(1, garbage_list_.Scavenge());
+  EXPECT_EQ(1, items[0].deallocations);
+}
+
+TEST_F(HazardPointerGarbageListTest, ReleaseRecordOnThreadExit) {
+  MockItem item;
+  std::atomic<MockItem*> source{&item};
+  for (uint64_t round = 0; round < 2 * garbage_list_.max_threads_; ++round) {
+    Thread worker([&]() {
+      MockItem* protected_item = nullptr;
+      EXPECT_TRUE(garbage_list_.Protect(1, source, &protected_item));
+    });
+    worker.join();
+  }
+  for (uint64_t i = 0; i < garbage_list_.max_threads_; ++i) {
+    EXPECT_EQ(0lu, garbage_list_.records_[i].thread_id.load());
+    EXPECT_EQ(nullptr, garbage_list_.records_[i].hazards[1].load());
+  }
+}
+
+TEST_F(HazardPointerGarbageListTest, ScavengeTakesNoRecord) {
+  EXPECT_EQ(0, garbage_list_.Scavenge());
+  for (uint64_t i = 0; i < garbage_list_.max_threads_; ++i) {
+    EXPECT_EQ(0lu, garbage_list_.records_[i].thread_id.load());
+  }
+}
+
+TEST_F(HazardPointerGarbageListTest, MoreThreadsThanRecords) {
+  MockItem items[8];
+  std::atomic<MockItem*> source{&items[0]};
+  std::atomic<uint32_t> started{0};
+  std::atomic<bool> done{false};
+
+  // Readers take all four records, one of them keeps its own retired item.
+  std::vector<std::unique_ptr<Thread>> readers;
+  for (uint32_t i = 0; i < 4; ++i) {
+    readers.emplace_back(new Thread([&, i]() {
+      MockItem* protected_item = nullptr;
+      EXPECT_TRUE(garbage_list_.Protect(0, source, &protected_item));
+      if (i == 0) {
+        EXPECT_TRUE(garbage_list_.Push(&items[7], MockItem::Destroy, nullptr));
+      }
+      started += 1;
+      while (!done) std::this_thread::yield();
+    }));
+  }
+  while (started < 4) std::this_thread::yield();
+
+  // This thread gets no record; its items must not be dropped.
+  for (int i = 0; i < 7; ++i) {
+    EXPECT_TRUE(garbage_list_.Push(&items[i], MockItem::Destroy, nullptr));
+  }
+  EXPECT_EQ(6, garbage_list_.Scavenge());
+  EXPECT_EQ(0, items[0].deallocations);
+  EXPECT_EQ(0, items[7].deallocations);
+
+  // Records of exited threads are swept without waiting for a new owner.
+  done = true;
+  for (auto& reader : readers) reader->join();
+  EXPECT_EQ(2, garbage_list_.Scavenge());
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,176 @@
+#include "../interval_garbage_list.h"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <vector>
+
+struct MockItem {
+ public:
+  MockItem() : deallocations{0} {}
+
+  static void Destroy(void* destroyContext, void* p) {
+    ++(reinterpret_cast<MockItem*>(p))->deallocations;
+  }
+
+  std::atomic<uint64_t> deallocations;
+};
+
+class IntervalGarbageListTest : public ::testing::Test {
+ public:
+  IntervalGarbageListTest() {}
+
+ protected:
+  EpochManager epoch_manager_;
+  IntervalGarbageList garbage_list_;
+
+  virtual void SetUp() {
+    ASSERT_TRUE(epoch_manager_.Initialize(EpochManager::kIntervalBased));
+    ASSERT_TRUE(garbage_list_.Initialize(&epoch_manager_, 64));
+  }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(garbage_list_.Uninitialize());
+    EXPECT_TRUE(epoch_manager_.Uninitialize());
+    Thread::ClearRegistry(true);
+  }
+};
+
+TEST_F(IntervalGarbageListTest, Uninitialize) {
+  MockItem items[2];
+
+  EXPECT_TRUE(garbage_list_.Push(&items[0], MockItem::Destroy, nullptr));
+  EXPECT_TRUE(garbage_list_.Push(&items[1], MockItem::Destroy, nullptr));
+  EXPECT_TRUE(garbage_list_.Uninitialize());
+  EXPECT_EQ(1, items[0].deallocations);
+  EXPECT_EQ(1, items[1].deallocations);
+}
+
+TEST_F(IntervalGarbageListTest, RequiresIntervalBasedEpochs) {
+  EpochManager epoch_manager;
+  ASSERT_TRUE(epoch_manager.Initialize());
+  IntervalGarbageList garbage_list;
+  EXPECT_FALSE(garbage_list.Initialize(&epoch_manager));
+  EXPECT_TRUE(epoch_manager.Uninitialize());
+}
+
+TEST_F(IntervalGarbageListTest, StalledReaderOnlyPinsOverlappingItems) {
+  MockItem old_item;
+  std::atomic<MockItem*> source{&old_item};
+  Epoch old_birth = epoch_manager_.GetCurrentEpoch();
+  std::atomic<bool> reading{false};
+  std::atomic<bool> done{false};
+
+  // Reader enters, reads once, and stalls.
+  Thread reader([&]() {
+    EpochGuard guard(&epoch_manager_);
+    EXPECT_EQ(&old_item, epoch_manager_.ProtectPointer(source));
+    reading = true;
+    while (!done) std::this_thread::yield();
+  });
+  while (!reading) std::this_thread::yield();
+
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_TRUE(
+      garbage_list_.PushWithBirth(&old_item, old_birth, MockItem::Destroy,
+                                  nullptr));
+
+  // Items born after the reader's last read are reclaimed despite it.
+  MockItem young_items[8];
+  for (auto& item : young_items) {
+    EXPECT_TRUE(garbage_list_.PushWithBirth(
+        &item, epoch_manager_.GetCurrentEpoch(), MockItem::Destroy, nullptr));
+  }
+  EXPECT_EQ(8, garbage_list_.Scavenge());
+  EXPECT_EQ(0, old_item.deallocations);
+  for (auto& item : young_items) EXPECT_EQ(1, item.deallocations);
+
+  done = true;
+  reader.join();
+  EXPECT_EQ(1, garbage_list_.Scavenge());
+  EXPECT_EQ(1, old_item.deallocations);
+}
+
+TEST_F(IntervalGarbageListTest, ReaderEntersWhileScavengingCurrentEpoch) {
+  // Items are replaced, retired and scavenged right away, in the epoch the
+  // reader may be entering: no epoch has to pass, so only the reader's
+  // reservation keeps the item it reads alive, and it must be visible before
+  // the read.
+  static const uint32_t kItemCount = 20000;
+  std::vector<MockItem> items(kItemCount);
+  std::atomic<MockItem*> source{&items[0]};
+  std::atomic<bool> done{false};
+
+  Thread reader([&]() {
+    EpochManager::ThreadContext context(&epoch_manager_);
+    while (!done) {
+      EXPECT_TRUE(context.Protect());
+      MockItem* item = context.ProtectPointer(source);
+      EXPECT_EQ(0, item->deallocations);
+      EXPECT_TRUE(context.Unprotect());
+      EXPECT_TRUE(epoch_manager_.Protect());
+      item = epoch_manager_.ProtectPointer(source);
+      EXPECT_EQ(0, item->deallocations);
+      EXPECT_TRUE(epoch_manager_.Unprotect());
+    }
+  });
+
+  Epoch birth = epoch_manager_.GetCurrentEpoch();
+  for (uint32_t i = 1; i < kItemCount; ++i) {
+    Epoch next_birth = epoch_manager_.GetCurrentEpoch();
+    MockItem* old_item = source.exchange(&items[i]);
+    EXPECT_TRUE(garbage_list_.PushWithBirth(old_item, birth, MockItem::Destroy,
+                                            nullptr));
+    garbage_list_.Scavenge();
+    birth = next_birth;
+  }
+  done = true;
+  reader.join();
+
+  // Destroy the leftovers while the items are still alive.
+  EXPECT_TRUE(garbage_list_.Uninitialize());
+  for (uint32_t i = 0; i + 1 < kItemCount; ++i) {
+    EXPECT_EQ(1, items[i].deallocations);
+  }
+  EXPECT_EQ(0, items[kItemCount - 1].deallocations);
+}
+
+TEST_F(IntervalGarbageListTest, ProtectPointerExtendsReservation) {
+  MockItem item;
+  std::atomic<MockItem*> source{&item};
+  EpochGuard guard(&epoch_manager_);
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(&item, epoch_manager_.ProtectPointer(source));
+
+  std::vector<EpochManager::Reservation> reservations;
+  epoch_manager_.GetReservations(&reservations);
+  ASSERT_EQ(1u, reservations.size());
+  EXPECT_EQ(1llu, reservations[0].lower);
+  EXPECT_EQ(2llu, reservations[0].upper);
+
+  EpochManager::ThreadContext context(&epoch_manager_);
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(&item, context.ProtectPointer(source));
+  epoch_manager_.GetReservations(&reservations);
+  ASSERT_EQ(1u, reservations.size());
+  EXPECT_EQ(3llu, reservations[0].upper);
+}
+
+TEST_F(IntervalGarbageListTest, AdoptListOfExitedThread) {
+  MockItem item;
+  Thread worker([&]() {
+    EXPECT_TRUE(garbage_list_.Push(&item, MockItem::Destroy, nullptr));
+  });
+  worker.join();
+  ASSERT_EQ(1u, garbage_list_.lists_.size());
+  EXPECT_EQ(0lu, garbage_list_.lists_[0]->thread_id.load());
+
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(1, garbage_list_.Scavenge());
+  EXPECT_EQ(1, item.deallocations);
+  EXPECT_EQ(1u, garbage_list_.lists_.size());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
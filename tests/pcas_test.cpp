@@ -1,6 +1,8 @@
 #include "../pcas.h"
 #include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <thread>
+#include <vector>
 
 GTEST_TEST(PCASTest, SmokeTest) {
   LOG(INFO) << "running tests";
@@ -50,6 +52,57 @@ TEST_F(DirtyTablePMTest, SimpleRecovery) {
   EXPECT_EQ(target, 99);
 }
 
+TEST(DirtyBitPCASTest, SimpleCAS) {
+  uint64_t target{0};
+  for (uint64_t i = 1; i < 100; i += 1) {
+    auto rv = PersistentCAS<DirtyBitPolicy>(&target, i - 1, i);
+    EXPECT_EQ(rv, i - 1);
+    EXPECT_EQ(target, i);
+  }
+  // A failed CAS reports the current value and changes nothing.
+  EXPECT_EQ(PersistentCAS<DirtyBitPolicy>(&target, 5, 6), 99);
+  EXPECT_EQ(PersistentRead<DirtyBitPolicy>(&target), 99);
+}
+
+TEST(DirtyBitPCASTest, DirtyValue) {
+  // As left by a crash, or a writer between install and clear.
+  uint64_t target{7 | DirtyBitPolicy::kDirtyBitMask};
+  EXPECT_EQ(PersistentRead<DirtyBitPolicy>(&target), 7);
+  EXPECT_EQ(target, 7);
+
+  // A writer helps the dirty value it expects and succeeds.
+  target = 7 | DirtyBitPolicy::kDirtyBitMask;
+  EXPECT_EQ(PersistentCAS<DirtyBitPolicy>(&target, 7, 8), 7);
+  EXPECT_EQ(target, 8);
+
+  // And fails on one it does not, leaving it persisted.
+  target = 9 | DirtyBitPolicy::kDirtyBitMask;
+  EXPECT_EQ(PersistentCAS<DirtyBitPolicy>(&target, 7, 8), 9);
+  EXPECT_EQ(target, 9);
+}
+
+TEST(DirtyBitPCASTest, Concurrent) {
+  static const uint32_t kThreadCnt = 4;
+  static const uint32_t kOpCnt = 10000;
+  alignas(kCacheLineSize) uint64_t target{0};
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < kThreadCnt; t += 1) {
+    threads.emplace_back([&target]() {
+      for (uint32_t i = 0; i < kOpCnt; i += 1) {
+        uint64_t value = PersistentRead<DirtyBitPolicy>(&target);
+        while (PersistentCAS<DirtyBitPolicy>(&target, value, value + 1) !=
+               value) {
+          value = PersistentRead<DirtyBitPolicy>(&target);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(target, kThreadCnt * kOpCnt);
+}
+
 }  // namespace very_pm
 
 int main(int argc, char** argv) {
@@ -0,0 +1,155 @@
+#include "../pmwcas.h"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <memory>
+
+namespace very_pm {
+
+class PMwCASTest : public ::testing::Test {
+ public:
+  PMwCASTest() {}
+
+ protected:
+  static const constexpr uint32_t descriptor_cnt_ = 64;
+  EpochManager epoch_manager_;
+  DescriptorPool pool_;
+  Descriptor* descriptors_{nullptr};
+
+  virtual void SetUp() {
+    posix_memalign((void**)&descriptors_, kCacheLineSize,
+                   sizeof(Descriptor) * descriptor_cnt_);
+    ASSERT_TRUE(epoch_manager_.Initialize());
+    ASSERT_TRUE(pool_.Initialize(&epoch_manager_, descriptors_,
+                                 descriptor_cnt_, 8));
+  }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(pool_.Uninitialize());
+    EXPECT_TRUE(epoch_manager_.Uninitialize());
+    free(descriptors_);
+    Thread::ClearRegistry(true);
+  }
+};
+
+TEST_F(PMwCASTest, SingleThread) {
+  alignas(kCacheLineSize) uint64_t words[3] = {0, 0, 0};
+  EpochGuard guard(&epoch_manager_);
+
+  Descriptor* descriptor = pool_.AllocateDescriptor();
+  ASSERT_NE(nullptr, descriptor);
+  EXPECT_TRUE(descriptor->AddWord(&words[2], 0, 3));
+  EXPECT_TRUE(descriptor->AddWord(&words[0], 0, 1));
+  EXPECT_FALSE(descriptor->AddWord(&words[0], 0, 2));
+  EXPECT_FALSE(descriptor->AddWord(&words[1], 0, Descriptor::kDirtyFlag));
+  EXPECT_TRUE(descriptor->MwCAS());
+  EXPECT_EQ(1u, PMwCASRead(&words[0]));
+  EXPECT_EQ(0u, PMwCASRead(&words[1]));
+  EXPECT_EQ(3u, PMwCASRead(&words[2]));
+
+  // One stale word fails the whole PMwCAS.
+  descriptor = pool_.AllocateDescriptor();
+  ASSERT_NE(nullptr, descriptor);
+  EXPECT_TRUE(descriptor->AddWord(&words[0], 1, 10));
+  EXPECT_TRUE(descriptor->AddWord(&words[1], 0, 20));
+  EXPECT_TRUE(descriptor->AddWord(&words[2], 0, 30));
+  EXPECT_FALSE(descriptor->MwCAS());
+  EXPECT_EQ(1u, words[0]);
+  EXPECT_EQ(0u, words[1]);
+  EXPECT_EQ(3u, words[2]);
+}
+
+TEST_F(PMwCASTest, ReuseDescriptors) {
+  alignas(kCacheLineSize) uint64_t words[2] = {0, 0};
+  // Every partition holds 8 descriptors, retired ones come back once the
+  // epoch moves on.
+  for (uint64_t i = 0; i < 100; ++i) {
+    EpochGuard guard(&epoch_manager_);
+    Descriptor* descriptor = pool_.AllocateDescriptor();
+    if (!descriptor) {
+      // Leave the protected region so the retired descriptors can expire.
+      epoch_manager_.Unprotect();
+      epoch_manager_.BumpCurrentEpoch();
+      epoch_manager_.BumpCurrentEpoch();
+      epoch_manager_.Protect();
+      descriptor = pool_.AllocateDescriptor();
+    }
+    ASSERT_NE(nullptr, descriptor);
+    EXPECT_TRUE(descriptor->AddWord(&words[0], i, i + 1));
+    EXPECT_TRUE(descriptor->AddWord(&words[1], i, i + 1));
+    EXPECT_TRUE(descriptor->MwCAS());
+  }
+  EXPECT_EQ(100u, words[0]);
+  EXPECT_EQ(100u, words[1]);
+}
+
+TEST_F(PMwCASTest, Concurrent) {
+  static const uint64_t kOpCnt = 2000;
+  alignas(kCacheLineSize) uint64_t words[2 * kCacheLineSize / 8] = {};
+  uint64_t* first = &words[0];
+  uint64_t* second = &words[kCacheLineSize / 8];
+  std::atomic<uint64_t> succeeded{0};
+
+  std::vector<std::unique_ptr<Thread>> threads;
+  for (uint32_t t = 0; t < 4; ++t) {
+    threads.emplace_back(new Thread([&]() {
+      for (uint64_t i = 0; i < kOpCnt; ++i) {
+        EpochGuard guard(&epoch_manager_);
+        Descriptor* descriptor = pool_.AllocateDescriptor();
+        if (!descriptor) continue;
+        uint64_t first_v = PMwCASRead(first);
+        uint64_t second_v = PMwCASRead(second);
+        descriptor->AddWord(first, first_v, first_v + 1);
+        descriptor->AddWord(second, second_v, second_v + 1);
+        if (descriptor->MwCAS()) succeeded += 1;
+      }
+    }));
+  }
+  for (auto& thread : threads) thread->join();
+
+  // Both words always move together, and no flag is left behind.
+  EXPECT_LT(0u, succeeded.load());
+  EXPECT_EQ(succeeded.load(), *first);
+  EXPECT_EQ(succeeded.load(), *second);
+}
+
+TEST_F(PMwCASTest, Recovery) {
+  alignas(kCacheLineSize) uint64_t words[4] = {1, 2, 3, 4};
+  EXPECT_TRUE(pool_.Uninitialize());
+
+  // Crashed after deciding, with one word installed and one already done.
+  Descriptor& decided = descriptors_[0];
+  decided.status_ = Descriptor::kStatusSucceeded | Descriptor::kDirtyFlag;
+  decided.count_ = 2;
+  decided.words_[0] = WordDescriptor{&words[0], 1, 10, &decided};
+  decided.words_[1] = WordDescriptor{&words[1], 2, 20, &decided};
+  words[0] = reinterpret_cast<uint64_t>(&decided) | Descriptor::kMwCASFlag |
+             Descriptor::kDirtyFlag;
+  words[1] = 20 | Descriptor::kDirtyFlag;
+
+  // Crashed while installing.
+  Descriptor& undecided = descriptors_[1];
+  undecided.status_ = Descriptor::kStatusUndecided;
+  undecided.count_ = 2;
+  undecided.words_[0] = WordDescriptor{&words[2], 3, 30, &undecided};
+  undecided.words_[1] = WordDescriptor{&words[3], 4, 40, &undecided};
+  words[2] = reinterpret_cast<uint64_t>(&undecided) | Descriptor::kMwCASFlag;
+  words[3] = reinterpret_cast<uint64_t>(&undecided.words_[1]) |
+             Descriptor::kRDCSSFlag;
+
+  EXPECT_EQ(2u, DescriptorPool::Recovery(descriptors_, descriptor_cnt_));
+  EXPECT_EQ(10u, words[0]);
+  EXPECT_EQ(20u, words[1]);
+  EXPECT_EQ(3u, words[2]);
+  EXPECT_EQ(4u, words[3]);
+  for (uint32_t i = 0; i < descriptor_cnt_; ++i) {
+    EXPECT_EQ(Descriptor::kStatusFree, descriptors_[i].status_);
+  }
+  EXPECT_EQ(0u, DescriptorPool::Recovery(descriptors_, descriptor_cnt_));
+}
+
+}  // namespace very_pm
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
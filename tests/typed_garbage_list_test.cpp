@@ -0,0 +1,134 @@
+#include "../typed_garbage_list.h"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+struct MockItem {
+ public:
+  MockItem() : deallocations{0} {}
+
+  std::atomic<uint64_t> deallocations;
+};
+
+struct MockDeleter {
+  void operator()(MockItem* item) { ++item->deallocations; }
+};
+
+class TypedGarbageListTest : public ::testing::Test {
+ public:
+  TypedGarbageListTest() {}
+
+ protected:
+  EpochManager epoch_manager_;
+  TypedGarbageList<MockItem, MockDeleter> garbage_list_;
+
+  virtual void SetUp() {
+    ASSERT_TRUE(epoch_manager_.Initialize());
+    ASSERT_TRUE(garbage_list_.Initialize(&epoch_manager_, 1024));
+  }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(garbage_list_.Uninitialize());
+    EXPECT_TRUE(epoch_manager_.Uninitialize());
+    Thread::ClearRegistry(true);
+  }
+};
+
+TEST_F(TypedGarbageListTest, Uninitialize) {
+  MockItem items[2];
+
+  EXPECT_TRUE(garbage_list_.Push(&items[0]));
+  EXPECT_TRUE(garbage_list_.Push(&items[1]));
+  EXPECT_TRUE(garbage_list_.Uninitialize());
+  EXPECT_EQ(1, items[0].deallocations);
+  EXPECT_EQ(1, items[1].deallocations);
+}
+
+TEST_F(TypedGarbageListTest, Scavenge) {
+  MockItem items[10];
+  epoch_manager_.Protect();
+  for (auto& item : items) EXPECT_TRUE(garbage_list_.Push(&item));
+  EXPECT_EQ(0, garbage_list_.Scavenge());
+  epoch_manager_.Unprotect();
+
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(10, garbage_list_.Scavenge());
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+}
+
+TEST_F(TypedGarbageListTest, ScavengeSlowPusher) {
+  MockItem items[3];
+  EXPECT_TRUE(garbage_list_.Push(&items[0]));
+  // A pusher took a position but has not claimed its slot yet.
+  int64_t position = garbage_list_.tail_.fetch_add(1) - 1;
+  EXPECT_TRUE(garbage_list_.Push(&items[1]));
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(2, garbage_list_.Scavenge());
+
+  // Its item is not stepped over once it lands.
+  auto& slot = garbage_list_.items_[position & (1024 - 1)];
+  slot.removed_item = &items[2];
+  slot.removal_epoch = epoch_manager_.GetCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  epoch_manager_.BumpCurrentEpoch();
+  EXPECT_EQ(1, garbage_list_.Scavenge());
+  for (auto& item : items) EXPECT_EQ(1, item.deallocations);
+}
+
+TEST_F(TypedGarbageListTest, FailWhenFull) {
+  TypedGarbageList<MockItem, MockDeleter> garbage_list;
+  ASSERT_TRUE(garbage_list.Initialize(
+      &epoch_manager_, 16,
+      TypedGarbageList<MockItem, MockDeleter>::OverflowPolicy::kFail));
+  MockItem items[17];
+  epoch_manager_.Protect();
+  for (int i = 0; i < 16; ++i) EXPECT_TRUE(garbage_list.Push(&items[i]));
+  EXPECT_FALSE(garbage_list.Push(&items[16]));
+  epoch_manager_.Unprotect();
+  EXPECT_TRUE(garbage_list.Uninitialize());
+  EXPECT_EQ(0, items[16].deallocations);
+}
+
+TEST_F(TypedGarbageListTest, BlockWhenFull) {
+  TypedGarbageList<MockItem, MockDeleter> garbage_list;
+  ASSERT_TRUE(garbage_list.Initialize(
+      &epoch_manager_, 16,
+      TypedGarbageList<MockItem, MockDeleter>::OverflowPolicy::kBlock));
+  MockItem items[17];
+  std::atomic<bool> reader_protected{false};
+  std::atomic<bool> release{false};
+  Thread reader([&]() {
+    epoch_manager_.Protect();
+    reader_protected = true;
+    while (!release) std::this_thread::yield();
+    epoch_manager_.Unprotect();
+  });
+  while (!reader_protected) std::this_thread::yield();
+
+  for (int i = 0; i < 16; ++i) EXPECT_TRUE(garbage_list.Push(&items[i]));
+  Thread unblocker([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    release = true;
+  });
+  EXPECT_TRUE(garbage_list.Push(&items[16]));
+  uint64_t deallocations = 0;
+  for (auto& item : items) deallocations += item.deallocations;
+  EXPECT_EQ(1u, deallocations);
+  unblocker.join();
+  reader.join();
+}
+
+TEST_F(TypedGarbageListTest, DefaultDelete) {
+  TypedGarbageList<uint64_t> garbage_list;
+  ASSERT_TRUE(garbage_list.Initialize(&epoch_manager_, 16));
+  for (int i = 0; i < 64; ++i) {
+    EXPECT_TRUE(garbage_list.Push(new uint64_t{static_cast<uint64_t>(i)}));
+  }
+  EXPECT_TRUE(garbage_list.Uninitialize());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
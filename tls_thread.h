@@ -1,9 +1,12 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
+#include <functional>
 #include <list>
 #include <mutex>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
 /// A wrapper for std::thread that bookkeeps C++11 thread_local variables to
 /// handle thread/TLS variable interactions.  The key problem is avoding
@@ -22,11 +25,32 @@
 /// point to previously destroyed resources.
 ///
 /// Here we keep it always the thread that resets its own TLS variables.
+///
+/// A TLS variable may also carry an exit callback, which is invoked when the
+/// owning thread is joined or destroyed. Resources that are keyed by thread
+/// (e.g., epoch table entries) use it to hand their slot back instead of
+/// leaking it when the thread goes away.
 class Thread : public std::thread {
  public:
-  /// Pairs of <pointer to variable, invalid value>, supports 8-byte word types
-  /// only for now.
-  typedef std::list<std::pair<uint64_t *, uint64_t> > TlsList;
+  /// Invoked with the context supplied to RegisterTls() when the thread that
+  /// registered the variable exits.
+  typedef void (*ExitCallback)(void *context);
+
+  /// A registered TLS variable: pointer to the variable, its invalid value and
+  /// an optional callback to run when the owning thread exits.
+  struct TlsVariable {
+    TlsVariable(uint64_t *ptr, uint64_t val, ExitCallback callback,
+                void *context)
+        : ptr(ptr), val(val), callback(callback), context(context) {}
+
+    uint64_t *ptr;
+    uint64_t val;
+    ExitCallback callback;
+    void *context;
+  };
+
+  /// Supports 8-byte word types only for now.
+  typedef std::list<TlsVariable> TlsList;
 
   static std::unordered_map<std::thread::id, TlsList *> registry_;
   static std::mutex registryMutex_;
@@ -43,11 +67,26 @@ class Thread : public std::thread {
   }
 
   /// Register a thread-local variable
-  /// @ptr - pointer to the TLS variable
+  /// @ptr - pointer to the TLS variable, may be nullptr to only register
+  ///        @callback
   /// @val - default value of the TLS variable
-  static void RegisterTls(uint64_t *ptr, uint64_t val);
+  /// @callback - optional, called with @context when this thread exits
+  static void RegisterTls(uint64_t *ptr, uint64_t val,
+                          ExitCallback callback = nullptr,
+                          void *context = nullptr);
+
+  /// Forget a variable registered by the calling thread with @context,
+  /// without resetting it or invoking its exit callback.
+  static void UnregisterTls(uint64_t *ptr, void *context);
+
+  /// Forget the variables of all threads whose context lies in [@begin, @end),
+  /// without resetting them or invoking their exit callbacks. Used by
+  /// resources that are about to be destroyed.
+  static void UnregisterTlsInRange(const void *begin, const void *end);
 
-  /// Clear/reset the entire global TLS registry covering all threads
+  /// Clear/reset the entire global TLS registry covering all threads. Exit
+  /// callbacks are NOT invoked: this is used when the resources they refer to
+  /// have already been destroyed.
   static void ClearRegistry(bool destroy = false);
 
  private:
@@ -56,16 +95,110 @@ class Thread : public std::thread {
   std::thread::id id_;
 };
 
+/// Per-thread cache of one word per owner: the calling thread's entry in an
+/// epoch table, its retired list in a garbage list, and so on, so finding it
+/// is a TLS load instead of a search of the owner.
+///
+/// Owners take an id from AcquireOwner() when they are initialized and give
+/// it back with ReleaseOwner(). Ids are never reused, so a slot left behind by
+/// a released owner is never mistaken for a live one; such slots are reclaimed
+/// by the thread holding them once it runs out of free ones. A thread using
+/// more than kSlots live owners at once gets no slot for the rest, and the
+/// owner falls back to its own lookup.
+class ThreadSlots {
+ public:
+  static const uint32_t kSlots = 32;
+
+  struct Slot {
+    /// Id of the owner, 0 if the slot is free.
+    uint64_t owner;
+    uint64_t value;
+  };
+
+  static uint64_t AcquireOwner();
+  static void ReleaseOwner(uint64_t owner);
+
+  /// Returns the calling thread's slot for @owner, nullptr if it has none.
+  static Slot *Find(uint64_t owner) {
+    Slot *hint = &slots_[hint_];
+    if (hint->owner == owner) return hint;
+    for (uint32_t i = 0; i < kSlots; ++i) {
+      if (slots_[i].owner == owner) {
+        hint_ = i;
+        return &slots_[i];
+      }
+    }
+    return nullptr;
+  }
+
+  /// Take a slot of the calling thread for @owner, with a zero value.
+  /// Returns nullptr if every slot belongs to a live owner.
+  static Slot *Claim(uint64_t owner);
+
+  /// Free the calling thread's slot for @owner, if any.
+  static void Clear(uint64_t owner) {
+    Slot *slot = Find(owner);
+    if (slot) *slot = Slot{};
+  }
+
+ private:
+  static Slot *FindFree() {
+    for (uint32_t i = 0; i < kSlots; ++i) {
+      if (slots_[i].owner == 0) {
+        hint_ = i;
+        return &slots_[i];
+      }
+    }
+    return nullptr;
+  }
+
+  static std::atomic<uint64_t> next_owner_;
+
+  /// Owners acquired and not released yet, and the number of releases so
+  /// far, which tells a thread whether sweeping its slots can free any.
+  static std::mutex owners_mutex_;
+  static std::unordered_set<uint64_t> live_owners_;
+  static std::atomic<uint64_t> released_;
+
+  static thread_local Slot slots_[kSlots];
+  /// Index of the slot found last.
+  static thread_local uint32_t hint_;
+  /// #released_ as of the last sweep of #slots_.
+  static thread_local uint64_t swept_;
+};
+
 std::unordered_map<std::thread::id, Thread::TlsList *> Thread::registry_;
 std::mutex Thread::registryMutex_;
 
-void Thread::RegisterTls(uint64_t *ptr, uint64_t val) {
+void Thread::RegisterTls(uint64_t *ptr, uint64_t val, ExitCallback callback,
+                         void *context) {
   auto id = std::this_thread::get_id();
   std::unique_lock<std::mutex> lock(registryMutex_);
   if (registry_.find(id) == registry_.end()) {
     registry_.emplace(id, new TlsList);
   }
-  registry_[id]->emplace_back(ptr, val);
+  registry_[id]->emplace_back(ptr, val, callback, context);
+}
+
+void Thread::UnregisterTls(uint64_t *ptr, void *context) {
+  auto id = std::this_thread::get_id();
+  std::unique_lock<std::mutex> lock(registryMutex_);
+  auto iter = registry_.find(id);
+  if (iter != registry_.end()) {
+    iter->second->remove_if([ptr, context](const TlsVariable &entry) {
+      return entry.ptr == ptr && entry.context == context;
+    });
+  }
+}
+
+void Thread::UnregisterTlsInRange(const void *begin, const void *end) {
+  std::less<const void *> less;
+  std::unique_lock<std::mutex> lock(registryMutex_);
+  for (auto &r : registry_) {
+    r.second->remove_if([&](const TlsVariable &entry) {
+      return !less(entry.context, begin) && less(entry.context, end);
+    });
+  }
 }
 
 void Thread::ClearTls(bool destroy) {
@@ -74,7 +207,12 @@ void Thread::ClearTls(bool destroy) {
   if (iter != registry_.end()) {
     auto *list = iter->second;
     for (auto &entry : *list) {
-      *entry.first = entry.second;
+      if (entry.callback) {
+        entry.callback(entry.context);
+      }
+      if (entry.ptr) {
+        *entry.ptr = entry.val;
+      }
     }
     if (destroy) {
       delete list;
@@ -90,7 +228,9 @@ void Thread::ClearRegistry(bool destroy) {
   for (auto &r : registry_) {
     auto *list = r.second;
     for (auto &entry : *list) {
-      *entry.first = entry.second;
+      if (entry.ptr) {
+        *entry.ptr = entry.val;
+      }
     }
     if (destroy) {
       delete list;
@@ -102,3 +242,45 @@ void Thread::ClearRegistry(bool destroy) {
     registry_.clear();
   }
 }
+
+std::atomic<uint64_t> ThreadSlots::next_owner_{1};
+std::mutex ThreadSlots::owners_mutex_;
+std::unordered_set<uint64_t> ThreadSlots::live_owners_;
+std::atomic<uint64_t> ThreadSlots::released_{0};
+thread_local ThreadSlots::Slot ThreadSlots::slots_[kSlots] = {};
+thread_local uint32_t ThreadSlots::hint_ = 0;
+thread_local uint64_t ThreadSlots::swept_ = 0;
+
+uint64_t ThreadSlots::AcquireOwner() {
+  uint64_t owner = next_owner_.fetch_add(1, std::memory_order_relaxed);
+  std::unique_lock<std::mutex> lock(owners_mutex_);
+  live_owners_.insert(owner);
+  return owner;
+}
+
+void ThreadSlots::ReleaseOwner(uint64_t owner) {
+  Clear(owner);
+  std::unique_lock<std::mutex> lock(owners_mutex_);
+  if (live_owners_.erase(owner)) {
+    released_.fetch_add(1, std::memory_order_release);
+  }
+}
+
+ThreadSlots::Slot *ThreadSlots::Claim(uint64_t owner) {
+  Slot *slot = FindFree();
+  if (!slot) {
+    uint64_t released = released_.load(std::memory_order_acquire);
+    if (released == swept_) return nullptr;
+    std::unique_lock<std::mutex> lock(owners_mutex_);
+    for (auto &candidate : slots_) {
+      if (!live_owners_.count(candidate.owner)) candidate = Slot{};
+    }
+    swept_ = released;
+    lock.unlock();
+    slot = FindFree();
+    if (!slot) return nullptr;
+  }
+  slot->owner = owner;
+  slot->value = 0;
+  return slot;
+}